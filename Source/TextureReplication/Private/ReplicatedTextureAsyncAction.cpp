@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureAsyncAction.h"
+
+UReplicateTexrureFromFileAction* UReplicateTexrureFromFileAction::ReplicateTexrureFromFileAsync(UReplicatedTextureComponent* component
+	, const FString& path, const FString& name, ETextureCodec codec, int32 priority)
+{
+	UReplicateTexrureFromFileAction* action = NewObject<UReplicateTexrureFromFileAction>();
+	action->component = component;
+	action->path = path;
+	action->name = name;
+	action->codec = codec;
+	action->priority = priority;
+
+	// Kept alive until the texture is created
+	if (IsValid(component))
+	{
+		action->RegisterWithGameInstance(component);
+	}
+	return action;
+}
+
+void UReplicateTexrureFromFileAction::Activate()
+{
+	if (!IsValid(component))
+	{
+		OnFailed.Broadcast(name, nullptr);
+		SetReadyToDestroy();
+		return;
+	}
+
+	// Continuation runs on game thread, where the future is set
+	TWeakObjectPtr<UReplicateTexrureFromFileAction> weakThis(this);
+	component->ReplicateTexrureFromFileAsync(path, name, codec, priority).Next([weakThis](UTexture2D* texture) {
+		UReplicateTexrureFromFileAction* action = weakThis.Get();
+		if (action == nullptr) return;
+
+		if (IsValid(texture))
+		{
+			action->OnStarted.Broadcast(action->name, texture);
+		}
+		else
+		{
+			action->OnFailed.Broadcast(action->name, nullptr);
+		}
+		action->SetReadyToDestroy();
+	});
+}
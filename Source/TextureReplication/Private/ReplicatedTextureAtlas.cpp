@@ -0,0 +1,188 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureAtlas.h"
+#include "ReplicatedTextureCodec.h"
+#include "ReplicatedTextureSettings.h"
+#include "Engine/Texture2D.h"
+#include "TextureResource.h"
+
+namespace
+{
+	const int32 bytesPerPixel = 4;
+}
+
+bool FTextureAtlas::CanAdd(const FDecodedTexture& decoded)
+{
+	const UReplicatedTextureSettings* settings = GetDefault<UReplicatedTextureSettings>();
+
+	// Dedicated server never shows textures
+	if (!settings->bUseAtlas || IsRunningDedicatedServer()) return false;
+
+	// Pixels of other formats or with mips can't be copied into a page as they are
+	return decoded.format == PF_B8G8R8A8 && decoded.width > 0 && decoded.height > 0
+		&& decoded.width <= settings->atlasMaxTextureSize && decoded.height <= settings->atlasMaxTextureSize
+		&& decoded.pixels.Num() == (int64)decoded.width * decoded.height * bytesPerPixel;
+}
+
+UTexture2D* FTextureAtlas::Add(const FString& name, const FDecodedTexture& decoded)
+{
+	Remove(name);
+
+	const int32 width = decoded.width + padding * 2;
+	const int32 height = decoded.height + padding * 2;
+
+	FAtlasSlot slot;
+	for (int32 i = 0; i < layouts.Num() && slot.page == INDEX_NONE; i++)
+	{
+		if (IsValid(pages[i]) && layouts[i].bSRGB == decoded.bSRGB && allocate(layouts[i], width, height, slot.rect))
+		{
+			slot.page = i;
+		}
+	}
+
+	if (slot.page == INDEX_NONE)
+	{
+		const int32 page = addPage(decoded.bSRGB);
+		if (page == INDEX_NONE || !allocate(layouts[page], width, height, slot.rect)) return nullptr;
+
+		slot.page = page;
+	}
+
+	UTexture2D* page = pages[slot.page];
+	layouts[slot.page].numSlots++;
+	slots.Add(name, slot);
+
+	FUpdateTextureRegion2D* region = new FUpdateTextureRegion2D(slot.rect.Min.X + padding, slot.rect.Min.Y + padding
+		, 0, 0, decoded.width, decoded.height);
+
+	// Render thread reads them later, freed by the cleanup callback
+	uint8* pixels = (uint8*)FMemory::Malloc(decoded.pixels.Num());
+	FMemory::Memcpy(pixels, decoded.pixels.GetData(), decoded.pixels.Num());
+
+	page->UpdateTextureRegions(0, 1, region, decoded.width * bytesPerPixel, bytesPerPixel, pixels,
+		[](uint8* data, const FUpdateTextureRegion2D* updatedRegion) {
+			FMemory::Free(data);
+			delete updatedRegion;
+		});
+
+	return page;
+}
+
+int64 FTextureAtlas::Remove(const FString& name)
+{
+	FAtlasSlot slot;
+	if (!slots.RemoveAndCopyValue(name, slot)) return 0;
+
+	FAtlasPageLayout& layout = layouts[slot.page];
+	layout.freeRects.Add(slot.rect);
+
+	if (--layout.numSlots > 0) return 0;
+
+	// Nothing is left on the page, the next one starts empty
+	const int64 size = IsValid(pages[slot.page]) ? pages[slot.page]->CalcTextureMemorySizeEnum(TMC_AllMips) : 0;
+	pages[slot.page] = nullptr;
+	layout = FAtlasPageLayout();
+	return size;
+}
+
+bool FTextureAtlas::FindRect(const FString& name, FIntRect& rect) const
+{
+	const FAtlasSlot* slot = slots.Find(name);
+	if (slot == nullptr) return false;
+
+	rect = FIntRect(slot->rect.Min + FIntPoint(padding), slot->rect.Max - FIntPoint(padding));
+	return true;
+}
+
+bool FTextureAtlas::FindSlot(const FString& name, FReplicatedTextureAtlasSlot& slot) const
+{
+	FIntRect rect;
+	if (!FindRect(name, rect)) return false;
+
+	const int32 page = slots.FindChecked(name).page;
+	const FVector2D size(layouts[page].size, layouts[page].size);
+
+	slot.page = pages[page];
+	slot.uvMin = FVector2D(rect.Min) / size;
+	slot.uvMax = FVector2D(rect.Max) / size;
+	return true;
+}
+
+bool FTextureAtlas::allocate(FAtlasPageLayout& layout, int32 width, int32 height, FIntRect& rect) const
+{
+	// Smallest freed slot the texture fits into
+	int32 bestFree = INDEX_NONE;
+	for (int32 i = 0; i < layout.freeRects.Num(); i++)
+	{
+		const FIntRect& freeRect = layout.freeRects[i];
+		if (freeRect.Width() < width || freeRect.Height() < height) continue;
+
+		if (bestFree == INDEX_NONE || freeRect.Area() < layout.freeRects[bestFree].Area())
+		{
+			bestFree = i;
+		}
+	}
+
+	if (bestFree != INDEX_NONE)
+	{
+		rect = layout.freeRects[bestFree];
+		layout.freeRects.RemoveAtSwap(bestFree);
+		return true;
+	}
+
+	// Lowest shelf with room, so less height is wasted
+	FAtlasShelf* shelf = nullptr;
+	for (FAtlasShelf& candidate : layout.shelves)
+	{
+		if (candidate.height < height || candidate.x + width > layout.size) continue;
+
+		if (shelf == nullptr || candidate.height < shelf->height)
+		{
+			shelf = &candidate;
+		}
+	}
+
+	if (shelf == nullptr)
+	{
+		if (layout.top + height > layout.size || width > layout.size) return false;
+
+		shelf = &layout.shelves.AddDefaulted_GetRef();
+		shelf->y = layout.top;
+		shelf->height = height;
+		layout.top += height;
+	}
+
+	rect = FIntRect(shelf->x, shelf->y, shelf->x + width, shelf->y + height);
+	shelf->x += width;
+	return true;
+}
+
+int32 FTextureAtlas::addPage(bool bSRGB)
+{
+	const int32 size = GetDefault<UReplicatedTextureSettings>()->atlasPageSize;
+
+	UTexture2D* page = UTexture2D::CreateTransient(size, size, PF_B8G8R8A8);
+	if (!IsValid(page)) return INDEX_NONE;
+
+	// Padding stays transparent
+	FTexture2DMipMap& mip = page->GetPlatformData()->Mips[0];
+	FMemory::Memzero(mip.BulkData.Lock(LOCK_READ_WRITE), mip.BulkData.GetBulkDataSize());
+	mip.BulkData.Unlock();
+
+	page->SRGB = bSRGB;
+	page->UpdateResource();
+
+	int32 index = pages.IndexOfByPredicate([](const TObjectPtr<UTexture2D>& existing) { return existing == nullptr; });
+	if (index == INDEX_NONE)
+	{
+		index = pages.Add(nullptr);
+		layouts.AddDefaulted();
+	}
+
+	pages[index] = page;
+	layouts[index] = FAtlasPageLayout();
+	layouts[index].size = size;
+	layouts[index].bSRGB = bSRGB;
+	return index;
+}
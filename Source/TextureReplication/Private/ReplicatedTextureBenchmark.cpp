@@ -0,0 +1,265 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureBenchmark.h"
+#include "ReplicatedTextureComponent.h"
+#include "ReplicatedTextureStream.h"
+#include "ImageCore.h"
+#include "ImageUtils.h"
+#include "Containers/Ticker.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectIterator.h"
+
+// Runs with -nullrhi, so a headless listen server or dedicated server with clients can do it on CI
+//
+// ReplicatedTexture.Benchmark Count=16 MinSize=64 MaxSize=2048 Timeout=300 [PktLag=100 PktLagVariance=20 PktLoss=1]
+// Packet simulation is applied to the server net driver, start clients with the same -PktLag= -PktLoss= to delay both ways
+namespace
+{
+	struct FBenchmarkRun
+	{
+		TWeakObjectPtr<UWorld> world;
+
+		TArray<FString> names;
+
+		int64 totalPixels = 0;
+
+		double startTime = 0;
+		double timeout = 0;
+
+		int64 bytesSentBefore = 0;
+		uint64 memoryBefore = 0;
+		uint64 peakMemory = 0;
+
+		double gameThreadMs = 0;
+		double maxGameThreadMs = 0;
+		int32 frames = 0;
+
+		TSharedRef<FReplicatedTextureBenchmarkResult> result = MakeShared<FReplicatedTextureBenchmarkResult>();
+	};
+
+	int32 runCounter = 0;
+
+	TArray<UReplicatedTextureComponent*> getComponents(UWorld* world)
+	{
+		TArray<UReplicatedTextureComponent*> components;
+		for (TObjectIterator<UReplicatedTextureComponent> it; it; ++it)
+		{
+			if (it->GetWorld() == world && it->HasBegunPlay())
+			{
+				components.Add(*it);
+			}
+		}
+		return components;
+	}
+
+	int64 getBytesSent(UWorld* world)
+	{
+		int64 bytes = 0;
+		for (const UReplicatedTextureComponent* component : getComponents(world))
+		{
+			bytes += component->GetTransferStats().bytesSent;
+		}
+
+		// Shared stream sends chunks no component answered for
+		AReplicatedTexturesStorage* storage = UReplicatedTextureComponent::textureStorage;
+		if (IsValid(storage) && IsValid(storage->stream))
+		{
+			bytes += storage->stream->GetBytesSent();
+		}
+		return bytes;
+	}
+
+	// Noise over a gradient, so codecs have real work to do
+	void fillImage(FImage& image, int32 seed)
+	{
+		FRandomStream random(seed);
+		uint8* pixels = image.RawData.GetData();
+
+		for (int32 y = 0; y < image.SizeY; y++)
+		{
+			for (int32 x = 0; x < image.SizeX; x++)
+			{
+				uint8* pixel = pixels + ((int64)y * image.SizeX + x) * 4;
+				pixel[0] = uint8(x * 255 / image.SizeX) ^ (uint8)random.RandHelper(32);
+				pixel[1] = uint8(y * 255 / image.SizeY) ^ (uint8)random.RandHelper(32);
+				pixel[2] = (uint8)random.RandHelper(256);
+				pixel[3] = 255;
+			}
+		}
+	}
+
+	bool tickBenchmark(const TSharedRef<FBenchmarkRun>& run)
+	{
+		UWorld* world = run->world.Get();
+		if (world == nullptr)
+		{
+			UE_LOG(LogReplicaetdTexture, Error, TEXT("Benchmark world is gone"));
+			run->result->bRunning = false;
+			run->result->bTimedOut = true;
+			return false;
+		}
+
+		const double now = FPlatformTime::Seconds();
+
+		run->peakMemory = FMath::Max<uint64>(run->peakMemory, FPlatformMemory::GetStats().UsedPhysical);
+
+		const double frameMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+		run->gameThreadMs += frameMs;
+		run->maxGameThreadMs = FMath::Max(run->maxGameThreadMs, frameMs);
+		run->frames++;
+
+		// Headers are stored once compression is done, jobs are reset at the same time
+		bool bDone = IsValid(UReplicatedTextureComponent::textureStorage);
+		for (int32 i = 0; bDone && i < run->names.Num(); i++)
+		{
+			bDone = UReplicatedTextureComponent::textureStorage->textureHeaders.Contains(run->names[i]);
+		}
+
+		for (const UReplicatedTextureComponent* component : getComponents(world))
+		{
+			bDone = bDone && component->GetAllJobsDone();
+		}
+
+		const double elapsed = now - run->startTime;
+		if (!bDone && elapsed < run->timeout) return true;
+
+		const int64 bytesSent = getBytesSent(world) - run->bytesSentBefore;
+
+		FReplicatedTextureBenchmarkResult& result = *run->result;
+		result.bRunning = false;
+		result.bTimedOut = !bDone;
+		result.numTextures = run->names.Num();
+		result.seconds = elapsed;
+		result.bytesSent = bytesSent;
+		result.bytesPerSecond = bytesSent / FMath::Max(elapsed, 0.001);
+		result.peakMemory = (int64)run->peakMemory - (int64)run->memoryBefore;
+		result.averageGameThreadMs = run->gameThreadMs / FMath::Max(run->frames, 1);
+		result.maxGameThreadMs = run->maxGameThreadMs;
+
+		UE_LOG(LogReplicaetdTexture, Display, TEXT("Benchmark %s: %d textures, %.1f MPixels, %d clients"), bDone ? TEXT("finished") : TEXT("timed out")
+			, run->names.Num(), run->totalPixels / 1000000.0, FMath::Max(0, getComponents(world).Num() - 1));
+		UE_LOG(LogReplicaetdTexture, Display, TEXT("  Time to all jobs done: %.2fs"), elapsed);
+		UE_LOG(LogReplicaetdTexture, Display, TEXT("  Sent: %.2f MB, %.1f KB/s"), bytesSent / (1024.0 * 1024.0), bytesSent / 1024.0 / FMath::Max(elapsed, 0.001));
+		UE_LOG(LogReplicaetdTexture, Display, TEXT("  Peak used memory: %.1f MB above the start"), result.peakMemory / (1024.0 * 1024.0));
+		UE_LOG(LogReplicaetdTexture, Display, TEXT("  Game thread: %.2f ms average, %.2f ms max over %d frames"), result.averageGameThreadMs
+			, result.maxGameThreadMs, run->frames);
+
+		return false;
+	}
+
+	void startBenchmark(const TArray<FString>& args, UWorld* world)
+	{
+		FReplicatedTextureBenchmark::Start(world, FString::Join(args, TEXT(" ")));
+	}
+
+	FAutoConsoleCommandWithWorldAndArgs benchmarkCommand(
+		TEXT("ReplicatedTexture.Benchmark"),
+		TEXT("Replicates generated textures to all clients and logs throughput, time to all jobs done, peak memory and game thread time. ")
+		TEXT("Args: Count= MinSize= MaxSize= Timeout= and packet simulation like PktLag= PktLoss="),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&startBenchmark));
+}
+
+TSharedPtr<FReplicatedTextureBenchmarkResult> FReplicatedTextureBenchmark::Start(UWorld* world, const FString& cmd)
+{
+	if (world == nullptr || (world->GetNetMode() != NM_ListenServer && world->GetNetMode() != NM_DedicatedServer))
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Benchmark runs on a listen or dedicated server"));
+		return nullptr;
+	}
+
+	TArray<UReplicatedTextureComponent*> components = getComponents(world);
+	if (components.IsEmpty())
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Benchmark needs a player with a replicated texture component"));
+		return nullptr;
+	}
+
+	int32 count = 16;
+	int32 minSize = 64;
+	int32 maxSize = 2048;
+	float timeout = 300.f;
+	FParse::Value(*cmd, TEXT("Count="), count);
+	FParse::Value(*cmd, TEXT("MinSize="), minSize);
+	FParse::Value(*cmd, TEXT("MaxSize="), maxSize);
+	FParse::Value(*cmd, TEXT("Timeout="), timeout);
+
+	count = FMath::Max(count, 1);
+	minSize = FMath::Max(minSize, 4);
+	maxSize = FMath::Max(maxSize, minSize);
+
+#if DO_ENABLE_NET_TEST
+	if (UNetDriver* driver = world->GetNetDriver())
+	{
+		FPacketSimulationSettings simulation;
+		if (simulation.ParseSettings(*cmd))
+		{
+			driver->SetPacketSimulationSettings(simulation);
+			UE_LOG(LogReplicaetdTexture, Display, TEXT("Benchmark simulates %d ms lag, %d%% loss"), simulation.PktLag, simulation.PktLoss);
+		}
+	}
+#endif // DO_ENABLE_NET_TEST
+
+	// Local player's component on a listen server, any one on a dedicated server
+	UReplicatedTextureComponent* sender = components[0];
+	if (APlayerController* player = world->GetFirstPlayerController())
+	{
+		if (UReplicatedTextureComponent* local = player->FindComponentByClass<UReplicatedTextureComponent>())
+		{
+			sender = local;
+		}
+	}
+
+	TSharedRef<FBenchmarkRun> run = MakeShared<FBenchmarkRun>();
+	run->world = world;
+	run->timeout = timeout;
+	run->bytesSentBefore = getBytesSent(world);
+
+	const FString directory = FPaths::ProjectSavedDir() / TEXT("ReplicatedTextures") / TEXT("Benchmark");
+	const int32 runIndex = runCounter++;
+
+	// Images are written first, so generating them isn't measured
+	TArray<FString> paths;
+	for (int32 i = 0; i < count; i++)
+	{
+		// Sizes grow geometrically from the smallest to the biggest
+		const float alpha = count > 1 ? float(i) / (count - 1) : 1.f;
+		const int32 size = FMath::Max(4, FMath::RoundToInt(minSize * FMath::Pow(float(maxSize) / minSize, alpha)) & ~3);
+
+		FImage image(size, size, ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+		fillImage(image, i);
+
+		const FString path = directory / FString::Printf(TEXT("%d_%d.png"), i, size);
+		if (!FImageUtils::SaveImageByExtension(*path, image))
+		{
+			UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't write benchmark image %s"), *path);
+			return nullptr;
+		}
+
+		paths.Add(path);
+		run->totalPixels += (int64)size * size;
+	}
+
+	run->startTime = FPlatformTime::Seconds();
+	run->memoryBefore = FPlatformMemory::GetStats().UsedPhysical;
+	run->peakMemory = run->memoryBefore;
+
+	for (int32 i = 0; i < paths.Num(); i++)
+	{
+		const FString name = FString::Printf(TEXT("Benchmark_%d_%d"), runIndex, i);
+		if (sender->ReplicateTexrureFromFile(paths[i], name))
+		{
+			run->names.Add(name);
+		}
+	}
+
+	UE_LOG(LogReplicaetdTexture, Display, TEXT("Benchmark started with %d textures from %d to %d pixels wide"), run->names.Num(), minSize, maxSize);
+
+	FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([run](float) { return tickBenchmark(run); }));
+
+	return run->result;
+}
@@ -0,0 +1,203 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureBlockCompression.h"
+#include "ReplicatedTextureCodec.h"
+#include "ReplicatedTextureSettings.h"
+
+namespace
+{
+	const int32 bytesPerPixel = 4;
+	const int32 numPixels = FTextureBlockCompression::blockSize * FTextureBlockCompression::blockSize;
+
+	uint16 ToRGB565(int32 r, int32 g, int32 b)
+	{
+		return uint16(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+	}
+
+	void FromRGB565(uint16 color, int32* rgb)
+	{
+		const int32 r = color >> 11;
+		const int32 g = (color >> 5) & 63;
+		const int32 b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	// Pixels are BGRA, block is written little endian
+	void CompressColor(const uint8* block, uint8* output)
+	{
+		int32 minColor[3] = { 255, 255, 255 };
+		int32 maxColor[3] = { 0, 0, 0 };
+		for (int32 i = 0; i < numPixels; i++)
+		{
+			for (int32 c = 0; c < 3; c++)
+			{
+				const int32 value = block[i * bytesPerPixel + 2 - c];
+				minColor[c] = FMath::Min(minColor[c], value);
+				maxColor[c] = FMath::Max(maxColor[c], value);
+			}
+		}
+
+		// Endpoints are moved inside the box, so the middle colors are used better
+		for (int32 c = 0; c < 3; c++)
+		{
+			const int32 inset = (maxColor[c] - minColor[c]) / 16;
+			minColor[c] += inset;
+			maxColor[c] -= inset;
+		}
+
+		uint16 color0 = ToRGB565(maxColor[0], maxColor[1], maxColor[2]);
+		uint16 color1 = ToRGB565(minColor[0], minColor[1], minColor[2]);
+
+		// First endpoint must be bigger, otherwise BC1 switches to three colors
+		if (color0 < color1)
+		{
+			Swap(color0, color1);
+		}
+
+		int32 palette[4][3];
+		FromRGB565(color0, palette[0]);
+		FromRGB565(color1, palette[1]);
+		for (int32 c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		uint32 indices = 0;
+		for (int32 i = 0; i < numPixels && color0 != color1; i++)
+		{
+			int32 best = 0;
+			int32 bestDistance = MAX_int32;
+			for (int32 p = 0; p < 4; p++)
+			{
+				int32 distance = 0;
+				for (int32 c = 0; c < 3; c++)
+				{
+					const int32 delta = block[i * bytesPerPixel + 2 - c] - palette[p][c];
+					distance += delta * delta;
+				}
+
+				if (distance < bestDistance)
+				{
+					best = p;
+					bestDistance = distance;
+				}
+			}
+			indices |= uint32(best) << (i * 2);
+		}
+
+		output[0] = color0 & 0xFF;
+		output[1] = color0 >> 8;
+		output[2] = color1 & 0xFF;
+		output[3] = color1 >> 8;
+		FMemory::Memcpy(output + 4, &indices, sizeof(indices));
+	}
+
+	void CompressAlpha(const uint8* block, uint8* output)
+	{
+		int32 alpha0 = 0;
+		int32 alpha1 = 255;
+		for (int32 i = 0; i < numPixels; i++)
+		{
+			alpha0 = FMath::Max<int32>(alpha0, block[i * bytesPerPixel + 3]);
+			alpha1 = FMath::Min<int32>(alpha1, block[i * bytesPerPixel + 3]);
+		}
+
+		// First endpoint is bigger, which selects eight interpolated values
+		int32 palette[8] = { alpha0, alpha1 };
+		for (int32 p = 1; p < 7; p++)
+		{
+			palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+		}
+
+		uint64 indices = 0;
+		for (int32 i = 0; i < numPixels && alpha0 != alpha1; i++)
+		{
+			int32 best = 0;
+			for (int32 p = 1; p < 8; p++)
+			{
+				if (FMath::Abs(block[i * bytesPerPixel + 3] - palette[p]) < FMath::Abs(block[i * bytesPerPixel + 3] - palette[best]))
+				{
+					best = p;
+				}
+			}
+			indices |= uint64(best) << (i * 3);
+		}
+
+		output[0] = (uint8)alpha0;
+		output[1] = (uint8)alpha1;
+		for (int32 i = 0; i < 6; i++)
+		{
+			output[2 + i] = uint8(indices >> (i * 8));
+		}
+	}
+
+	bool IsOpaque(const TArray64<uint8>& pixels)
+	{
+		for (int64 i = 3; i < pixels.Num(); i += bytesPerPixel)
+		{
+			if (pixels[i] != 255) return false;
+		}
+		return true;
+	}
+}
+
+bool FTextureBlockCompression::CanCompress(const FDecodedTexture& decoded)
+{
+	if (!GetDefault<UReplicatedTextureSettings>()->bBlockCompressRecievedTextures || IsRunningDedicatedServer()) return false;
+
+	// Mobile GPUs usually can't sample BC formats
+	if (!GPixelFormats[PF_DXT1].Supported || !GPixelFormats[PF_DXT5].Supported) return false;
+
+	// Top mip of block compressed texture must be made of whole blocks
+	return decoded.format == PF_B8G8R8A8 && decoded.width > 0 && decoded.height > 0
+		&& decoded.width % blockSize == 0 && decoded.height % blockSize == 0
+		&& decoded.pixels.Num() == (int64)decoded.width * decoded.height * bytesPerPixel;
+}
+
+bool FTextureBlockCompression::Compress(FDecodedTexture& decoded)
+{
+	if (!CanCompress(decoded)) return false;
+
+	const EPixelFormat format = IsOpaque(decoded.pixels) ? PF_DXT1 : PF_DXT5;
+
+	TArray64<uint8> blocks;
+	CompressPixels(decoded.pixels.GetData(), decoded.width, decoded.height, (int64)decoded.width * bytesPerPixel, format, blocks);
+
+	decoded.pixels = MoveTemp(blocks);
+	decoded.format = format;
+	return true;
+}
+
+void FTextureBlockCompression::CompressPixels(const uint8* pixels, int32 width, int32 height, int64 pitch, EPixelFormat format, TArray64<uint8>& blocks)
+{
+	const int32 blocksX = width / blockSize;
+	const int32 blocksY = height / blockSize;
+	const int32 blockBytes = GetBlockBytes(format);
+
+	blocks.SetNumUninitialized((int64)blocksX * blocksY * blockBytes);
+
+	uint8 block[numPixels * bytesPerPixel];
+	for (int32 y = 0; y < blocksY; y++)
+	{
+		for (int32 x = 0; x < blocksX; x++)
+		{
+			for (int32 row = 0; row < blockSize; row++)
+			{
+				FMemory::Memcpy(block + row * blockSize * bytesPerPixel
+					, pixels + (y * blockSize + row) * pitch + x * blockSize * bytesPerPixel, blockSize * bytesPerPixel);
+			}
+
+			uint8* output = blocks.GetData() + ((int64)y * blocksX + x) * blockBytes;
+			if (format == PF_DXT5)
+			{
+				CompressAlpha(block, output);
+				output += 8;
+			}
+			CompressColor(block, output);
+		}
+	}
+}
@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureBundle.h"
+#include "ReplicatedTextureComponent.h"
+#include "ReplicatedTexturePatch.h"
+#include "Hash/xxhash.h"
+
+FString FTextureBundles::GetBundleName(uint64 contentHash)
+{
+	return FString::Printf(TEXT("%cbundle%016llx"), FTexturePatches::separator, contentHash);
+}
+
+void FTextureBundles::Pack(FCompressedBatch& batch)
+{
+	TArray<TArray<int32>> groups;
+	int64 groupSize = 0;
+
+	for (int32 i = 0; i < batch.names.Num(); i++)
+	{
+		const int64 size = batch.textures[i].buffer.Num();
+		if (!batch.succeeded[i] || size > maxTextureSize) continue;
+
+		if (groups.IsEmpty() || groups.Last().Num() >= maxTextures || groupSize + size > maxBundleSize)
+		{
+			groups.AddDefaulted();
+			groupSize = 0;
+		}
+
+		groups.Last().Add(i);
+		groupSize += size;
+	}
+
+	for (const TArray<int32>& group : groups)
+	{
+		// Single texture is cheaper on its own
+		if (group.Num() < 2) continue;
+
+		FCompressedBundle& bundle = batch.bundles.AddDefaulted_GetRef();
+		for (int32 i : group)
+		{
+			bundle.bundle.names.Add(batch.names[i]);
+			bundle.bundle.headers.Add(batch.textures[i].header);
+			bundle.buffer.Append(batch.textures[i].buffer);
+		}
+
+		bundle.header.contentHash = FXxHash64::HashBuffer(bundle.buffer.GetData(), bundle.buffer.Num()).Hash;
+		bundle.header.compressedSize = bundle.buffer.Num();
+		bundle.header.numChunks = FMath::DivideAndRoundUp<int64>(bundle.buffer.Num(), UReplicatedTextureComponent::maxChunkSize);
+		bundle.name = GetBundleName(bundle.header.contentHash);
+	}
+}
+
+bool FTextureBundles::Validate(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle)
+{
+	if (bundle.names.Num() != bundle.headers.Num() || bundle.names.Num() < 2 || bundle.names.Num() > maxTextures)
+		return false;
+
+	if (name != GetBundleName(header.contentHash) || header.compressedSize > maxBundleSize) return false;
+
+	TSet<FString> names;
+	int64 size = 0;
+	for (int32 i = 0; i < bundle.names.Num(); i++)
+	{
+		const int64 textureSize = bundle.headers[i].compressedSize;
+		if (textureSize <= 0 || textureSize > maxTextureSize) return false;
+
+		bool bDuplicate = false;
+		names.Add(bundle.names[i], &bDuplicate);
+		if (bDuplicate) return false;
+
+		size += textureSize;
+	}
+
+	return size == header.compressedSize;
+}
+
+bool FTextureBundles::Unpack(const FTextureBundle& bundle, TArrayView64<const uint8> buffer, TArray<FTextureBufferRef>& buffers)
+{
+	int64 offset = 0;
+	for (const FTextureTransferHeader& header : bundle.headers)
+	{
+		if (offset + header.compressedSize > buffer.Num()) return false;
+
+		// Textures are small, each of them gets its own buffer so the bundle can be dropped
+		buffers.Add(MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>(buffer.GetData() + offset, header.compressedSize));
+		offset += header.compressedSize;
+	}
+
+	return offset == buffer.Num();
+}
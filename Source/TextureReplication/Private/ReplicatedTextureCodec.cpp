@@ -0,0 +1,481 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureCodec.h"
+#include "ReplicatedTextureComponent.h"
+#include "ImageUtils.h"
+#include "ImageCore.h"
+#include "Engine/Texture2D.h"
+#include "Misc/Compression.h"
+#include "RenderingThread.h"
+
+namespace
+{
+	EPixelFormat ToPixelFormat(ERawImageFormat::Type format)
+	{
+		switch (format)
+		{
+		case ERawImageFormat::G8: return PF_G8;
+		case ERawImageFormat::BGRA8: return PF_B8G8R8A8;
+		case ERawImageFormat::RGBA16F: return PF_FloatRGBA;
+		case ERawImageFormat::RGBA32F: return PF_A32B32G32R32F;
+		default: return PF_Unknown;
+		}
+	}
+
+	// Moves image pixels into decoded texture, converting them if they can't be uploaded as is
+	void MoveImageToDecoded(FImage& image, FDecodedTexture& decoded)
+	{
+		if (ToPixelFormat(image.Format) == PF_Unknown)
+		{
+			image.ChangeFormat(ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+		}
+
+		decoded.width = image.SizeX;
+		decoded.height = image.SizeY;
+		decoded.format = ToPixelFormat(image.Format);
+		decoded.bSRGB = image.IsGammaCorrected();
+		decoded.pixels = MoveTemp(image.RawData);
+	}
+
+	const uint8 pngSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	uint32 ReadBigEndian(const uint8* data)
+	{
+		return (uint32(data[0]) << 24) | (uint32(data[1]) << 16) | (uint32(data[2]) << 8) | uint32(data[3]);
+	}
+
+	// Raw size is what decoding allocates, so it must match the dimensions exactly
+	bool IsRawSizeValid(const FTextureTransferHeader& header)
+	{
+		if (header.format >= ERawImageFormat::MAX) return false;
+
+		const ERawImageFormat::Type rawFormat = (ERawImageFormat::Type)header.format;
+		if (ToPixelFormat(rawFormat) == PF_Unknown) return false;
+
+		const int64 expectedSize = (int64)header.width * header.height * ERawImageFormat::GetBytesPerPixel(rawFormat);
+		return header.rawSize == expectedSize && header.rawSize <= MAX_int32;
+	}
+
+	int64 GetPlatformDataSize(const FTextureTransferHeader& header)
+	{
+		if (header.format >= PF_MAX) return INDEX_NONE;
+
+		const FPixelFormatInfo& info = GPixelFormats[header.format];
+		if (info.BlockBytes == 0) return INDEX_NONE;
+
+		return (int64)FMath::DivideAndRoundUp(header.width, info.BlockSizeX)
+			* FMath::DivideAndRoundUp(header.height, info.BlockSizeY) * info.BlockBytes;
+	}
+
+	class FPngTextureCodec : public ITextureCodec
+	{
+	public:
+
+		virtual bool Encode(const FImage& image, FTextureTransferHeader& header, TArray64<uint8>& buffer) const override
+		{
+			if (!FImageUtils::CompressImage(buffer, TEXT("png"), image, -5)) return false;
+
+			header.codec = ETextureCodec::Png;
+			header.width = image.SizeX;
+			header.height = image.SizeY;
+			header.format = image.Format;
+			header.bSRGB = image.IsGammaCorrected();
+			header.rawSize = image.RawData.Num();
+			return true;
+		}
+
+		virtual bool Decode(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedTexture& decoded) const override
+		{
+			// Header comes from the network, so check IHDR before the decoder allocates
+			if (!Validate(header, buffer)) return false;
+
+			FImage image;
+			if (!FImageUtils::DecompressImage(buffer.GetData(), buffer.Num(), image)) return false;
+
+			if (image.SizeX != header.width || image.SizeY != header.height)
+			{
+				UE_LOG(LogReplicaetdTexture, Error, TEXT("Decoded png is %dx%d, header says %dx%d"), image.SizeX, image.SizeY, header.width, header.height);
+				return false;
+			}
+
+			MoveImageToDecoded(image, decoded);
+			return true;
+		}
+
+		// Dimensions are read from IHDR, which always comes first
+		virtual bool Validate(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer) const override
+		{
+			if (buffer.Num() < 24 || FMemory::Memcmp(buffer.GetData(), pngSignature, sizeof(pngSignature)) != 0
+				|| FMemory::Memcmp(buffer.GetData() + 12, "IHDR", 4) != 0)
+			{
+				return false;
+			}
+
+			return ReadBigEndian(buffer.GetData() + 16) == (uint32)header.width
+				&& ReadBigEndian(buffer.GetData() + 20) == (uint32)header.height;
+		}
+	};
+
+	// Uncompressed pixels packed with one of the FCompression formats
+	class FRawTextureCodec : public ITextureCodec
+	{
+	public:
+
+		FRawTextureCodec(ETextureCodec inCodec, FName inFormatName)
+			: codec(inCodec), formatName(inFormatName)
+		{
+		}
+
+		virtual bool Encode(const FImage& image, FTextureTransferHeader& header, TArray64<uint8>& buffer) const override
+		{
+			FImage converted;
+			const FImage* source = &image;
+			if (ToPixelFormat(image.Format) == PF_Unknown)
+			{
+				image.CopyTo(converted, ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+				source = &converted;
+			}
+
+			const int64 rawSize = source->RawData.Num();
+			if (rawSize > MAX_int32) return false;
+
+			int32 compressedSize = FCompression::CompressMemoryBound(formatName, rawSize);
+			buffer.SetNumUninitialized(compressedSize);
+
+			if (!FCompression::CompressMemory(formatName, buffer.GetData(), compressedSize, source->RawData.GetData(), rawSize))
+				return false;
+
+			buffer.SetNum(compressedSize);
+
+			header.codec = codec;
+			header.width = source->SizeX;
+			header.height = source->SizeY;
+			header.format = source->Format;
+			header.bSRGB = source->IsGammaCorrected();
+			header.rawSize = rawSize;
+			return true;
+		}
+
+		virtual bool Decode(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedTexture& decoded) const override
+		{
+			// Header comes from the network, so check it before allocating
+			if (!Validate(header, buffer)) return false;
+
+			const EPixelFormat pixelFormat = ToPixelFormat((ERawImageFormat::Type)header.format);
+
+			decoded.pixels.SetNumUninitialized(header.rawSize);
+			if (!FCompression::UncompressMemory(formatName, decoded.pixels.GetData(), header.rawSize, buffer.GetData(), buffer.Num()))
+				return false;
+
+			decoded.width = header.width;
+			decoded.height = header.height;
+			decoded.format = pixelFormat;
+			decoded.bSRGB = header.bSRGB;
+			return true;
+		}
+
+		virtual bool Validate(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer) const override
+		{
+			return IsRawSizeValid(header) && buffer.Num() > 0 && buffer.Num() <= MAX_int32;
+		}
+
+	private:
+
+		ETextureCodec codec;
+		FName formatName;
+	};
+
+	FTexturePlatformData* CreatePlatformData(const FDecodedTexture& decoded)
+	{
+		const FPixelFormatInfo& info = GPixelFormats[decoded.format];
+		const int64 expectedSize = (int64)FMath::DivideAndRoundUp(decoded.width, info.BlockSizeX)
+			* FMath::DivideAndRoundUp(decoded.height, info.BlockSizeY) * info.BlockBytes;
+
+		if (decoded.width <= 0 || decoded.height <= 0 || decoded.pixels.Num() != expectedSize)
+		{
+			UE_LOG(LogReplicaetdTexture, Error, TEXT("Decoded texture size doesn't match its format"));
+			return nullptr;
+		}
+
+		FTexturePlatformData* platformData = new FTexturePlatformData();
+		platformData->SizeX = decoded.width;
+		platformData->SizeY = decoded.height;
+		platformData->PixelFormat = decoded.format;
+		platformData->SetNumSlices(1);
+
+		FTexture2DMipMap* mip = new FTexture2DMipMap();
+		mip->SizeX = decoded.width;
+		mip->SizeY = decoded.height;
+		mip->SizeZ = 1;
+		platformData->Mips.Add(mip);
+
+		mip->BulkData.Lock(LOCK_READ_WRITE);
+		void* data = mip->BulkData.Realloc(decoded.pixels.Num());
+		FMemory::Memcpy(data, decoded.pixels.GetData(), decoded.pixels.Num());
+		mip->BulkData.Unlock();
+
+		return platformData;
+	}
+
+	// Sends the first mip of the platform data, receiver uploads it as is
+	class FPlatformTextureCodec : public ITextureCodec
+	{
+	public:
+
+		virtual bool Encode(const FImage& image, FTextureTransferHeader& header, TArray64<uint8>& buffer) const override
+		{
+			// Plain images have no platform data
+			return false;
+		}
+
+		virtual bool EncodeTexture(UTexture2D* texture, FTextureTransferHeader& header, TArray64<uint8>& buffer) const override
+		{
+			const FTexturePlatformData* platformData = texture->GetPlatformData();
+			if (platformData == nullptr || platformData->Mips.IsEmpty()) return false;
+
+			const FTexture2DMipMap& mip = platformData->Mips[0];
+			if (!mip.BulkData.IsBulkDataLoaded()) return false;
+
+			const int64 size = mip.BulkData.GetBulkDataSize();
+			const uint8* data = (const uint8*)mip.BulkData.LockReadOnly();
+			buffer.Append(data, size);
+			mip.BulkData.Unlock();
+
+			header.codec = ETextureCodec::Platform;
+			header.width = mip.SizeX;
+			header.height = mip.SizeY;
+			header.format = platformData->PixelFormat;
+			header.bSRGB = texture->SRGB;
+			header.rawSize = size;
+			return true;
+		}
+
+		virtual bool Decode(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedTexture& decoded) const override
+		{
+			if (!Validate(header, buffer) || !GPixelFormats[header.format].Supported) return false;
+
+			const EPixelFormat pixelFormat = (EPixelFormat)header.format;
+
+			decoded.width = header.width;
+			decoded.height = header.height;
+			decoded.format = pixelFormat;
+			decoded.bSRGB = header.bSRGB;
+			decoded.pixels = TArray64<uint8>(buffer.GetData(), buffer.Num());
+			return true;
+		}
+
+		// Format doesn't have to be supported here, relay server never uploads it
+		virtual bool Validate(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer) const override
+		{
+			return buffer.Num() == GetPlatformDataSize(header);
+		}
+	};
+}
+
+bool ITextureCodec::EncodeTexture(UTexture2D* texture, FTextureTransferHeader& header, TArray64<uint8>& buffer) const
+{
+	FImage image;
+	if (!FTextureCodecs::GetSourceImage(texture, image)) return false;
+
+	return Encode(image, header, buffer);
+}
+
+bool ITextureCodec::Validate(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer) const
+{
+	return true;
+}
+
+TMap<ETextureCodec, TSharedRef<ITextureCodec>>& FTextureCodecs::GetCodecs()
+{
+	static TMap<ETextureCodec, TSharedRef<ITextureCodec>> codecs = [] {
+		TMap<ETextureCodec, TSharedRef<ITextureCodec>> builtIn;
+		builtIn.Add(ETextureCodec::Png, MakeShared<FPngTextureCodec>());
+		builtIn.Add(ETextureCodec::LZ4, MakeShared<FRawTextureCodec>(ETextureCodec::LZ4, NAME_LZ4));
+		builtIn.Add(ETextureCodec::Oodle, MakeShared<FRawTextureCodec>(ETextureCodec::Oodle, NAME_Oodle));
+		builtIn.Add(ETextureCodec::Platform, MakeShared<FPlatformTextureCodec>());
+		return builtIn;
+	}();
+
+	return codecs;
+}
+
+const ITextureCodec* FTextureCodecs::Find(ETextureCodec codec)
+{
+	const TSharedRef<ITextureCodec>* found = GetCodecs().Find(codec);
+
+	return found != nullptr ? &found->Get() : nullptr;
+}
+
+void FTextureCodecs::Register(ETextureCodec codec, TSharedRef<ITextureCodec> implementation)
+{
+	GetCodecs().Add(codec, implementation);
+}
+
+bool FTextureCodecs::GetSourceImage(UTexture2D* texture, FImage& image)
+{
+	if (FImageUtils::GetTexture2DSourceImage(texture, image)) return true;
+
+	const FTexturePlatformData* platformData = texture->GetPlatformData();
+	if (platformData == nullptr || platformData->Mips.IsEmpty() || platformData->PixelFormat != PF_B8G8R8A8) return false;
+
+	const FTexture2DMipMap& mip = platformData->Mips[0];
+	if (!mip.BulkData.IsBulkDataLoaded()) return false;
+
+	const int64 size = mip.BulkData.GetBulkDataSize();
+	if (size != (int64)mip.SizeX * mip.SizeY * 4) return false;
+
+	image.Init(mip.SizeX, mip.SizeY, ERawImageFormat::BGRA8, texture->SRGB ? EGammaSpace::sRGB : EGammaSpace::Linear);
+
+	const uint8* data = (const uint8*)mip.BulkData.LockReadOnly();
+	FMemory::Memcpy(image.RawData.GetData(), data, size);
+	mip.BulkData.Unlock();
+
+	return true;
+}
+
+bool FTextureCodecs::IsPng(TArrayView64<const uint8> buffer)
+{
+	return buffer.Num() > sizeof(pngSignature) && FMemory::Memcmp(buffer.GetData(), pngSignature, sizeof(pngSignature)) == 0;
+}
+
+void FTextureCodecs::MoveImage(FImage& image, FDecodedTexture& decoded)
+{
+	MoveImageToDecoded(image, decoded);
+}
+
+bool FTextureCodecs::PreparePlatformData(FDecodedTexture& decoded)
+{
+	decoded.platformData.Reset(CreatePlatformData(decoded));
+	decoded.pixels.Empty();
+
+	return decoded.platformData.IsValid();
+}
+
+UTexture2D* FTextureCodecs::CreateTexture(FDecodedTexture& decoded)
+{
+	UTexture2D* texture = NewObject<UTexture2D>(GetTransientPackage(), NAME_None, RF_Transient);
+
+	return UpdateTexture(texture, decoded) ? texture : nullptr;
+}
+
+bool FTextureCodecs::UpdateTexture(UTexture2D* texture, FDecodedTexture& decoded)
+{
+	FTexturePlatformData* platformData = decoded.platformData.IsValid() ? decoded.platformData.Release() : CreatePlatformData(decoded);
+	if (platformData == nullptr) return false;
+
+	texture->ReleaseResource();
+
+	FTexturePlatformData* oldPlatformData = texture->GetPlatformData();
+	texture->SetPlatformData(platformData);
+	texture->SRGB = decoded.bSRGB;
+	texture->UpdateResource();
+
+	// Render thread may still use old data until the old resource is released
+	if (oldPlatformData != nullptr)
+	{
+		ENQUEUE_RENDER_COMMAND(DeleteReplicatedTexturePlatformData)([oldPlatformData](FRHICommandListImmediate&) {
+			delete oldPlatformData;
+		});
+	}
+
+	return true;
+}
+
+bool FTextureCodecs::EncodeProgressive(const ITextureCodec& codec, const FImage& image, int32 minSize, FTextureTransferHeader& header, TArray64<uint8>& buffer)
+{
+	// Halve the size until it gets smaller than minSize
+	TArray<FIntPoint> sizes;
+	FIntPoint size(image.SizeX, image.SizeY);
+	sizes.Add(size);
+	while (sizes.Num() < maxSegments && FMath::Max(size.X, size.Y) / 2 >= minSize)
+	{
+		size = FIntPoint(FMath::Max(1, size.X / 2), FMath::Max(1, size.Y / 2));
+		sizes.Insert(size, 0);
+	}
+
+	// Single segment is the whole buffer, nothing to append
+	if (sizes.Num() == 1)
+	{
+		return codec.Encode(image, header, buffer);
+	}
+
+	TArray<FTextureSegment> segments;
+	for (const FIntPoint& segmentSize : sizes)
+	{
+		TArray64<uint8> segmentBuffer;
+		bool encoded;
+		if (segmentSize == FIntPoint(image.SizeX, image.SizeY))
+		{
+			encoded = codec.Encode(image, header, segmentBuffer);
+		}
+		else
+		{
+			FImage resized;
+			image.ResizeTo(resized, segmentSize.X, segmentSize.Y, image.Format, image.GammaSpace);
+			encoded = codec.Encode(resized, header, segmentBuffer);
+		}
+
+		if (!encoded) return false;
+
+		FTextureSegment& segment = segments.AddDefaulted_GetRef();
+		segment.size = segmentBuffer.Num();
+		segment.width = header.width;
+		segment.height = header.height;
+		segment.rawSize = header.rawSize;
+
+		buffer.Append(segmentBuffer);
+	}
+
+	// Header is left from the last, full size, segment
+	header.segments = MoveTemp(segments);
+	return true;
+}
+
+bool FTextureCodecs::Validate(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer)
+{
+	const ITextureCodec* codec = Find(header.codec);
+	if (codec == nullptr || buffer.Num() != header.compressedSize) return false;
+
+	for (int32 i = 0; i < GetNumSegments(header); i++)
+	{
+		int64 offset = 0;
+		int64 size = 0;
+		const FTextureTransferHeader segmentHeader = GetSegment(header, i, offset, size);
+
+		if (!codec->Validate(segmentHeader, buffer.Slice(offset, size))) return false;
+	}
+
+	return true;
+}
+
+int32 FTextureCodecs::GetNumSegments(const FTextureTransferHeader& header)
+{
+	return FMath::Max(1, header.segments.Num());
+}
+
+FTextureTransferHeader FTextureCodecs::GetSegment(const FTextureTransferHeader& header, int32 index, int64& offset, int64& size)
+{
+	FTextureTransferHeader segmentHeader = header;
+	segmentHeader.segments.Empty();
+
+	if (header.segments.IsEmpty())
+	{
+		offset = 0;
+		size = header.compressedSize;
+		return segmentHeader;
+	}
+
+	offset = 0;
+	for (int32 i = 0; i < index; i++)
+	{
+		offset += header.segments[i].size;
+	}
+
+	const FTextureSegment& segment = header.segments[index];
+	size = segment.size;
+	segmentHeader.width = segment.width;
+	segmentHeader.height = segment.height;
+	segmentHeader.rawSize = segment.rawSize;
+	return segmentHeader;
+}
@@ -2,9 +2,24 @@
 
 
 #include "ReplicatedTextureComponent.h"
+#include "ReplicatedTextureBlockCompression.h"
+#include "ReplicatedTextureBundle.h"
+#include "ReplicatedTextureCodec.h"
+#include "ReplicatedTextureDiskCache.h"
+#include "ReplicatedTexturePatch.h"
+#include "ReplicatedTextureSettings.h"
+#include "ReplicatedTextureStream.h"
+#include "ImageCore.h"
 #include "ImageUtils.h"
+#include "Algo/BinarySearch.h"
+#include "Async/ParallelFor.h"
+#include "Hash/xxhash.h"
+#include "Engine/ActorChannel.h"
+#include "Engine/NetConnection.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/FileHelper.h"
 #include "Net/UnrealNetwork.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
 
 DEFINE_LOG_CATEGORY(LogReplicaetdTexture);
 
@@ -14,10 +29,19 @@ UReplicatedTextureComponent::UReplicatedTextureComponent()
 {
 	PrimaryComponentTick.bCanEverTick = true;
 	SetIsReplicatedByDefault(true);
-	isDownloading = false;
-	chunkReady = true;
+	maxChunksInFlight = 8;
+	maxConcurrentTransfers = 4;
+	maxBytesInFlight = 1024 * 800;
+	pendingDecodes = 0;
+	scheduleOffset = 0;
+	lastStreamPartTime = 0;
 	bClientJobDone = true;
 	bAllJobsDone = true;
+	nextRelevancyUpdate = 0;
+	bytesSent = 0;
+	bytesRecieved = 0;
+	numChunkRetries = 0;
+	numTransferRetries = 0;
 }
 
 void UReplicatedTextureComponent::BeginPlay()
@@ -44,397 +68,2521 @@ void UReplicatedTextureComponent::BeginPlay()
 	}
 }
 
+void UReplicatedTextureComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (IsValid(textureStorage))
+	{
+		for (const TPair<FString, double>& served : servedTextures)
+		{
+			textureStorage->Unpin(served.Key);
+		}
+	}
+	servedTextures.Empty();
+
+	// Disconnect or travel, the next session continues from what arrived
+	if (GetNetMode() == NM_Client)
+	{
+		savePartialTransfers();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void UReplicatedTextureComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	if (!IsValid(textureStorage)) return;
+	if (!IsValid(textureStorage)) return;
+
+	updateStats();
+
+	// Answering the other side isn't paused
+	sendChunks();
+	releaseServedTextures(servedTimeout);
+
+	reloadTextures();
+
+	if (GetNetMode() == NM_Client)
+	{
+		downloadTextures();
+	}
+	else
+	{
+		updateRelevancy();
+	}
+
+	if (bPauseReplication) return;
+
+	// Queue is sorted by priority, its first entries download
+	// Transfers pushed out of the first slots keep what they got and continue later
+	int32 slot = 0;
+	for (const FString& name : namedQueue)
+	{
+		const bool bRunning = slot++ < maxConcurrentTransfers;
+
+		FTextureTransfer* started = activeTransfers.Find(name);
+		if (started != nullptr)
+		{
+			if (started->bPaused == bRunning)
+			{
+				UE_LOG(LogReplicaetdTexture, Log, TEXT("%s downloading texture \"%s\" at %llu"), bRunning ? TEXT("Resumed") : TEXT("Paused")
+					, *name, started->nextOffset);
+			}
+			started->bPaused = !bRunning;
+			continue;
+		}
+
+		if (bRunning)
+		{
+			startTransfer(name);
+		}
+	}
+
+	if (!activeTransfers.IsEmpty())
+	{
+		requestChunks();
+	}
+}
+
+void UReplicatedTextureComponent::startTransfer(const FString& name)
+{
+	UE_LOG(LogReplicaetdTexture, Log, TEXT("Started downloadning texture \"%s\""), *name);
+
+	FTextureTransfer& transfer = activeTransfers.Add(name);
+	transfer.name = name;
+	transfer.header = textureStorage->textureHeaders.FindChecked(name);
+	transfer.startTime = FPlatformTime::Seconds();
+	queuedTimes.RemoveAndCopyValue(name, transfer.queuedTime);
+
+	CSV_CUSTOM_STAT(TextureReplication, TimeInQueueMs, float((transfer.startTime - transfer.queuedTime) * 1000.0), ECsvCustomStatOp::Max);
+
+	// Size is known from the header, so the buffer is allocated once
+	transfer.totalSize = transfer.header.compressedSize;
+	transfer.buffer.SetNumUninitialized(transfer.totalSize);
+
+	if (GetNetMode() == NM_Client)
+	{
+		resumeTransfer(transfer);
+	}
+}
+
+void UReplicatedTextureComponent::requestChunks()
+{
+	const double now = FPlatformTime::Seconds();
+	const double streamFallbackDelay = GetDefault<UReplicatedTextureSettings>()->streamFallbackDelay;
+
+	TArray<FTextureTransfer*> transfers;
+	uint64 bytesInFlight = 0;
+	for (TPair<FString, FTextureTransfer>& pair : activeTransfers)
+	{
+		// Chunks of paused transfers still arrive
+		bytesInFlight += pair.Value.chunksInFlight.Num() * maxChunkSize;
+
+		// Streamed chunks are only asked for once the stream stops bringing them
+		// Until its first part is pushed the texture waits while the stream is busy with others
+		const double lastPart = pair.Value.lastStreamTime > 0 ? pair.Value.lastStreamTime
+			: FMath::Max(pair.Value.startTime, lastStreamPartTime);
+		const bool bStreaming = pair.Value.header.bStreamed && now - lastPart < streamFallbackDelay;
+
+		if (!pair.Value.bPaused && !pair.Value.bResuming && !bStreaming)
+		{
+			transfers.Add(&pair.Value);
+		}
+	}
+
+	if (transfers.IsEmpty()) return;
+
+	// At least one chunk must always fit into the budget
+	const uint64 budget = FMath::Max<uint64>(maxBytesInFlight, maxChunkSize);
+	const int32 first = scheduleOffset++ % transfers.Num();
+
+	// Round robin, one chunk per download per pass
+	bool asked = true;
+	while (asked && bytesInFlight + maxChunkSize <= budget)
+	{
+		asked = false;
+		for (int32 i = 0; i < transfers.Num() && bytesInFlight + maxChunkSize <= budget; i++)
+		{
+			if (requestNextChunk(*transfers[(first + i) % transfers.Num()]))
+			{
+				bytesInFlight += maxChunkSize;
+				asked = true;
+			}
+		}
+	}
+}
+
+bool UReplicatedTextureComponent::requestNextChunk(FTextureTransfer& transfer)
+{
+	// Already got these from the stream
+	while (transfer.streamedChunks.Contains(transfer.nextOffset))
+	{
+		transfer.nextOffset += maxChunkSize;
+	}
+
+	if (transfer.chunksInFlight.Num() >= maxChunksInFlight || transfer.nextOffset >= transfer.totalSize)
+		return false;
+
+	const uint64 begin = transfer.nextOffset;
+	askChunk(transfer.name, begin);
+	transfer.chunksInFlight.Add(begin);
+	transfer.nextOffset += maxChunkSize;
+
+	return true;
+}
+
+uint64 UReplicatedTextureComponent::getContiguousSize(const FTextureTransfer& transfer)
+{
+	// Everything before the first missing chunk
+	uint64 contiguous = FMath::Min(transfer.nextOffset, transfer.totalSize);
+	for (uint64 offset : transfer.chunksInFlight)
+	{
+		contiguous = FMath::Min(contiguous, offset);
+	}
+	return contiguous;
+}
+
+void UReplicatedTextureComponent::resumeTransfer(FTextureTransfer& transfer)
+{
+	if (!FReplicatedTextureDiskCache::Get().IsEnabled()) return;
+
+	// Buffer is filled on a worker, no chunks are asked for until it's back
+	transfer.bResuming = true;
+
+	const FString name = transfer.name;
+	const uint64 hash = transfer.header.contentHash;
+	const double startTime = transfer.startTime;
+
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, hash, startTime, buffer = MoveTemp(transfer.buffer), weakThis, this]() mutable {
+
+		// Reading and hashing the file takes a while for big textures
+		const int64 size = FReplicatedTextureDiskCache::Get().LoadPartial(hash, buffer);
+
+		AsyncTask(ENamedThreads::GameThread, [name, startTime, size, buffer = MoveTemp(buffer), weakThis, this]() mutable {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			// Cancelled or started again meanwhile
+			FTextureTransfer* transfer = activeTransfers.Find(name);
+			if (transfer == nullptr || !transfer->bResuming || transfer->startTime != startTime) return;
+
+			transfer->buffer = MoveTemp(buffer);
+			transfer->bResuming = false;
+
+			// Chunks are asked for at multiples of their size
+			const uint64 resumed = size - size % maxChunkSize;
+			if (resumed == 0) return;
+
+			transfer->nextOffset = resumed;
+			transfer->receivedSize = resumed;
+
+			UE_LOG(LogReplicaetdTexture, Log, TEXT("Resumed downloading texture \"%s\" from %llu"), *name, resumed);
+		});
+	});
+}
+
+void UReplicatedTextureComponent::savePartialTransfers()
+{
+	for (TPair<FString, FTextureTransfer>& pair : activeTransfers)
+	{
+		FTextureTransfer& transfer = pair.Value;
+
+		const uint64 contiguous = getContiguousSize(transfer);
+		if (contiguous == 0) continue;
+
+		transfer.buffer.SetNum(contiguous, EAllowShrinking::No);
+		FReplicatedTextureDiskCache::Get().SavePartial(transfer.header.contentHash, MoveTemp(transfer.buffer));
+	}
+	activeTransfers.Empty();
+}
+
+void UReplicatedTextureComponent::askChunk(const FString& name, uint64 begin)
+{
+	if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
+	{
+		askChunkOwner(name, begin);
+	}
+	if (GetNetMode() == NM_Client)
+	{
+		askChunkServer(name, begin);
+	}
+}
+
+void UReplicatedTextureComponent::updateStats() const
+{
+	INC_DWORD_STAT_BY(STAT_TextureReplication_Queued, namedQueue.Num());
+	INC_DWORD_STAT_BY(STAT_TextureReplication_ActiveTransfers, activeTransfers.Num());
+	INC_DWORD_STAT_BY(STAT_TextureReplication_PendingDecodes, pendingDecodes);
+
+	CSV_CUSTOM_STAT(TextureReplication, QueuedTextures, namedQueue.Num(), ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(TextureReplication, ActiveTransfers, activeTransfers.Num(), ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(TextureReplication, PendingDecodes, pendingDecodes, ECsvCustomStatOp::Accumulate);
+}
+
+FReplicatedTextureStats UReplicatedTextureComponent::GetTransferStats() const
+{
+	const double now = FPlatformTime::Seconds();
+
+	FReplicatedTextureStats stats;
+	stats.queuedTextures = namedQueue.Num();
+	stats.pendingDecodes = pendingDecodes;
+	stats.pendingChunkRequests = chunkRequests.Num();
+	stats.bytesSent = bytesSent;
+	stats.bytesRecieved = bytesRecieved;
+	stats.chunkRetries = numChunkRetries;
+	stats.transferRetries = numTransferRetries;
+
+	for (const TPair<FString, FTextureTransfer>& pair : activeTransfers)
+	{
+		const FTextureTransfer& transfer = pair.Value;
+
+		FReplicatedTextureTransferStats& transferStats = stats.transfers.AddDefaulted_GetRef();
+		transferStats.name = transfer.name;
+		transferStats.priority = transfer.header.priority;
+		transferStats.totalSize = transfer.totalSize;
+		transferStats.receivedSize = transfer.receivedSize;
+		transferStats.chunksInFlight = transfer.chunksInFlight.Num();
+		transferStats.chunkRetries = transfer.chunkRetries;
+		transferStats.bPaused = transfer.bPaused;
+		transferStats.timeInQueue = transfer.startTime - transfer.queuedTime;
+		transferStats.elapsed = now - transfer.startTime;
+
+		if (transfer.firstChunkTime > 0)
+		{
+			transferStats.timeToFirstChunk = transfer.firstChunkTime - transfer.startTime;
+		}
+	}
+
+	return stats;
+}
+
+void UReplicatedTextureComponent::enqueue(const FString& name)
+{
+	if (namedQueue.Contains(name)) return;
+
+	queuedTimes.Add(name, FPlatformTime::Seconds());
+
+	// After everything with the same or higher priority, so equal ones stay in arrival order
+	const int32 priority = getPriority(name);
+	const int32 index = Algo::UpperBoundBy(namedQueue, -priority, [this](const FString& queued) { return -getPriority(queued); });
+	namedQueue.Insert(name, index);
+}
+
+int32 UReplicatedTextureComponent::getPriority(const FString& name) const
+{
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	return header != nullptr ? header->priority : 0;
+}
+
+void UReplicatedTextureComponent::addChunkRequest(const FString& name, uint64 begin)
+{
+	if (!servedTextures.Contains(name))
+	{
+		textureStorage->Pin(name);
+	}
+	servedTextures.Add(name, FPlatformTime::Seconds());
+
+	// Higher priority chunks are sent first, the rest in the order they were asked for
+	const int32 priority = getPriority(name);
+	const int32 index = Algo::UpperBoundBy(chunkRequests, -priority, [](const FChunkRequest& request) { return -request.priority; });
+	chunkRequests.Insert({ name, begin, priority }, index);
+}
+
+void UReplicatedTextureComponent::GetLifetimeReplicatedProps(TArray< FLifetimeProperty >& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+	DOREPLIFETIME(UReplicatedTextureComponent, bAllJobsDone);
+}
+
+
+void UReplicatedTextureComponent::fetchTextures_Implementation()
+{
+	UE_LOG(LogReplicaetdTexture, Log, TEXT("Fetching textures(%d)")
+	, textureStorage->loadedTexturesNames.Num());
+
+	// Textures still being compressed will be announced when ready
+	for (const FString& name : textureStorage->loadedTexturesNames)
+	{
+		if (textureStorage->bundledTextures.Contains(name)) continue;
+
+		offerTexture(name);
+	}
+
+	// Bundles go as a whole, even if their textures are still being decoded
+	for (const TPair<FString, FTextureBundle>& pair : textureStorage->bundles)
+	{
+		if (!textureStorage->textureBuffers.Contains(pair.Key)) continue;
+
+		offerBundle(pair.Key);
+	}
+
+	// Receivers apply them in version order after the textures
+	for (const FString& name : textureStorage->patches)
+	{
+		offerTexture(name);
+	}
+}
+
+bool UReplicatedTextureComponent::ReplicateTexrure(UTexture2D* texture, const FString& name, ETextureCodec codec, int32 priority)
+{
+	if (!shouldReplicateTexture(name)) return false;
+
+	preReplicateTexture(texture, name);
+	beginReplicateTexture(name, resolveCodec(codec), priority);
+
+	return true;
+}
+
+bool UReplicatedTextureComponent::ReplicateTextures(const TArray<UTexture2D*>& textures, const TArray<FString>& names, ETextureCodec codec, int32 priority)
+{
+	if (textures.Num() != names.Num())
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Got %d textures, but %d names"), textures.Num(), names.Num());
+		return false;
+	}
+
+	TArray<FString> batchNames;
+	TArray<UTexture2D*> batchTextures;
+	for (int32 i = 0; i < textures.Num(); i++)
+	{
+		if (!IsValid(textures[i]))
+		{
+			UE_LOG(LogReplicaetdTexture, Warning, TEXT("Texture \"%s\" is null, skipping"), *names[i]);
+			continue;
+		}
+
+		// Also skips names repeated in the batch, the first one is already added
+		if (!shouldReplicateTexture(names[i])) continue;
+
+		preReplicateTexture(textures[i], names[i]);
+		batchNames.Add(names[i]);
+		batchTextures.Add(textures[i]);
+	}
+
+	if (batchNames.IsEmpty()) return false;
+
+	beginReplicateBatch(batchNames, batchTextures, resolveCodec(codec), priority);
+	return true;
+}
+
+bool UReplicatedTextureComponent::ReplicateTexrureFromFile(const FString& path, const FString& name, ETextureCodec codec, int32 priority)
+{
+	if (!shouldReplicateTexture(name)) return false;
+
+	FImage img;
+	if (!FImageUtils::LoadImage(*path, img))
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Failed to load image from file %s"), *path);
+		return false;
+	}
+
+	UTexture2D* texture = FImageUtils::CreateTexture2DFromImage(img);
+
+	if (!IsValid(texture))
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Failed to create texture from image %s"), *path);
+		return false;
+	}
+
+	preReplicateTexture(texture, name);
+	beginReplicateSource(name, MoveTemp(img), resolveCodec(codec), priority);
+	
+	return true;
+}
+
+TFuture<UTexture2D*> UReplicatedTextureComponent::ReplicateTexrureFromFileAsync(const FString& path, const FString& name, ETextureCodec codec, int32 priority)
+{
+	TSharedRef<TPromise<UTexture2D*>, ESPMode::ThreadSafe> promise = MakeShared<TPromise<UTexture2D*>, ESPMode::ThreadSafe>();
+	TFuture<UTexture2D*> future = promise->GetFuture();
+
+	if (!shouldReplicateTexture(name))
+	{
+		promise->SetValue(nullptr);
+		return future;
+	}
+
+	codec = resolveCodec(codec);
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [path, name, codec, priority, promise, weakThis] {
+		TSharedRef<FCompressedTexture, ESPMode::ThreadSafe> compressed = MakeShared<FCompressedTexture, ESPMode::ThreadSafe>();
+		TSharedRef<FDecodedTexture, ESPMode::ThreadSafe> decoded = MakeShared<FDecodedTexture, ESPMode::ThreadSafe>();
+
+		TArray64<uint8> file;
+		FImage image;
+		bool succeed = FFileHelper::LoadFileToArray(file, *path) && FImageUtils::DecompressImage(file.GetData(), file.Num(), image);
+
+		if (!succeed)
+		{
+			UE_LOG(LogReplicaetdTexture, Error, TEXT("Failed to load image from file %s"), *path);
+		}
+		else
+		{
+			succeed = compressFile(MoveTemp(file), image, name, codec, *compressed);
+			compressed->header.priority = priority;
+
+			// Local texture is built here too, game thread only creates it
+			FTextureCodecs::MoveImage(image, *decoded);
+			succeed = succeed && FTextureCodecs::PreparePlatformData(*decoded);
+		}
+
+		AsyncTask(ENamedThreads::GameThread, [name, compressed, decoded, succeed, promise, weakThis] {
+			UReplicatedTextureComponent* component = weakThis.Get();
+
+			// Same name could have been replicated meanwhile
+			if (!succeed || component == nullptr || !IsValid(textureStorage) || !component->shouldReplicateTexture(name))
+			{
+				promise->SetValue(nullptr);
+				return;
+			}
+
+			UTexture2D* texture = FTextureCodecs::CreateTexture(*decoded);
+			if (!IsValid(texture))
+			{
+				UE_LOG(LogReplicaetdTexture, Error, TEXT("Failed to create texture \"%s\""), *name);
+				promise->SetValue(nullptr);
+				return;
+			}
+
+			component->preReplicateTexture(texture, name);
+			finishCompression(name, MoveTemp(*compressed), true, component);
+			promise->SetValue(texture);
+		});
+	});
+
+	return future;
+}
+
+bool UReplicatedTextureComponent::UpdateTexture(UTexture2D* texture, const FString& name)
+{
+	if (GetNetMode() == NM_Standalone || !IsValid(texture)) return false;
+
+	if (!textureStorage->IsLoaded(name) || !textureStorage->textureTiles.Contains(name))
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Can not update texture \"%s\", it isn't replicated or it isn't BGRA8"), *name);
+		return false;
+	}
+
+	// Versions must have no gaps, so patches of one texture are made one by one
+	if (updatesInProgress.Contains(name))
+	{
+		queuedUpdates.Add(name, texture);
+		return true;
+	}
+
+	beginUpdateTexture(name, texture);
+	return true;
+}
+
+void UReplicatedTextureComponent::beginUpdateTexture(const FString& name, UTexture2D* texture)
+{
+	// Keeps the texture referenced while it is read on worker thread
+	textureStorage->atlas.Remove(name);
+	textureStorage->replicatedTextures.Add(name, texture);
+	textureStorage->evictedTextures.Remove(name);
+	textureStorage->Pin(name);
+	updatesInProgress.Add(name);
+
+	const TArray<uint64> oldHashes = textureStorage->textureTiles.FindChecked(name).hashes;
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, texture, oldHashes, weakThis, this] {
+		FImage image;
+		TSharedRef<FCompressedTexture, ESPMode::ThreadSafe> compressed = MakeShared<FCompressedTexture, ESPMode::ThreadSafe>();
+
+		bool succeed = FTextureCodecs::GetSourceImage(texture, image);
+		if (succeed && image.Format != ERawImageFormat::BGRA8)
+		{
+			image.ChangeFormat(ERawImageFormat::BGRA8, EGammaSpace::sRGB);
+		}
+		succeed = succeed && FTexturePatches::Encode(image, oldHashes, compressed->tiles.hashes, compressed->header, compressed->buffer)
+			&& sealCompressed(name, compressed->header, compressed->buffer);
+
+		AsyncTask(ENamedThreads::GameThread, [name, compressed, succeed, weakThis, this] {
+			if (!IsValid(textureStorage)) return;
+
+			textureStorage->Unpin(name);
+			if (!weakThis.IsValid()) return;
+
+			updatesInProgress.Remove(name);
+
+			// Fails also when nothing changed
+			if (succeed)
+			{
+				const int32 version = textureStorage->textureVersions.FindRef(name) + 1;
+				const FString patchName = FTexturePatches::GetPatchName(name, version);
+
+				compressed->header.patchTarget = name;
+				compressed->header.version = version;
+				compressed->header.baseVersion = version - 1;
+				compressed->header.priority = getPriority(name);
+
+				textureStorage->textureVersions.Add(name, version);
+				textureStorage->textureTiles.FindChecked(name).hashes = MoveTemp(compressed->tiles.hashes);
+				textureStorage->patches.Add(patchName);
+
+				storeCompressed(patchName, MoveTemp(*compressed));
+				announceTexture(patchName);
+			}
+
+			TWeakObjectPtr<UTexture2D> next;
+			if (queuedUpdates.RemoveAndCopyValue(name, next) && next.IsValid())
+			{
+				beginUpdateTexture(name, next.Get());
+			}
+		});
+	});
+}
+
+bool UReplicatedTextureComponent::shouldReplicateTexture(const FString& name)
+{
+	if (GetNetMode() == NM_Standalone) return false;
+
+	if (name.IsEmpty())
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("To replicate texture name must be not emtpy!"), *name);
+		return false;
+	}
+
+	if (name.Contains(FString::Chr(FTexturePatches::separator)))
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Texture name \"%s\" must not contain '%c'"), *name, FTexturePatches::separator);
+		return false;
+	}
+
+	if (textureStorage->IsLoaded(name))
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Can not replicate texture with name \"%s\", it is already replicated"), *name);
+		return false;
+	}
+
+	return true;
+}
+
+
+void UReplicatedTextureComponent::preReplicateTexture(UTexture2D* texture, const FString& name)
+{
+	textureStorage->replicatedTextures.Add(name, texture);
+	textureStorage->loadedTexturesNames.Add(name);
+
+	// Not evicted while it is compressed
+	textureStorage->Pin(name);
+}
+
+void UReplicatedTextureComponent::beginReplicateTexture(const FString& name, ETextureCodec codec, int32 priority)
+{
+	UTexture2D* texture = textureStorage->replicatedTextures.FindChecked(name);
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+
+	// Texture is pinned in the storage, so it stays alive while it is read on worker thread
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, texture, codec, priority, weakThis] {
+		TSharedRef<FCompressedTexture, ESPMode::ThreadSafe> compressed = MakeShared<FCompressedTexture, ESPMode::ThreadSafe>();
+		bool succeed = compressTexture(texture, name, codec, *compressed);
+		compressed->header.priority = priority;
+		
+		AsyncTask(ENamedThreads::GameThread, [name, compressed, succeed, weakThis] {
+			if (!IsValid(textureStorage)) return;
+
+			finishCompression(name, MoveTemp(*compressed), succeed && weakThis.IsValid(), weakThis.Get());
+		});
+	});
+}
+
+void UReplicatedTextureComponent::beginReplicateSource(const FString& name, FImage&& source, ETextureCodec codec, int32 priority)
+{
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, source = MoveTemp(source), codec, priority, weakThis] {
+		TSharedRef<FCompressedTexture, ESPMode::ThreadSafe> compressed = MakeShared<FCompressedTexture, ESPMode::ThreadSafe>();
+		bool succeed = compressImage(source, name, codec, *compressed);
+		compressed->header.priority = priority;
+
+		AsyncTask(ENamedThreads::GameThread, [name, compressed, succeed, weakThis] {
+			if (!IsValid(textureStorage)) return;
+
+			finishCompression(name, MoveTemp(*compressed), succeed && weakThis.IsValid(), weakThis.Get());
+		});
+	});
+}
+
+void UReplicatedTextureComponent::beginReplicateBatch(const TArray<FString>& names, const TArray<UTexture2D*>& textures, ETextureCodec codec, int32 priority)
+{
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+
+	// Textures are pinned in the storage, so they stay alive while they are read on worker threads
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [names, textures, codec, priority, weakThis] {
+		TSharedRef<FCompressedBatch, ESPMode::ThreadSafe> batch = MakeShared<FCompressedBatch, ESPMode::ThreadSafe>();
+		batch->names = names;
+		batch->textures.SetNum(names.Num());
+		batch->succeeded.SetNumZeroed(names.Num());
+
+		ParallelFor(names.Num(), [&batch, &names, &textures, codec, priority](int32 i) {
+			batch->succeeded[i] = compressTexture(textures[i], names[i], codec, batch->textures[i]);
+			batch->textures[i].header.priority = priority;
+		});
+
+		FTextureBundles::Pack(*batch);
+		for (FCompressedBundle& bundle : batch->bundles)
+		{
+			bundle.header.priority = priority;
+		}
+
+		AsyncTask(ENamedThreads::GameThread, [batch, weakThis] {
+			if (!IsValid(textureStorage)) return;
+
+			finishBatch(MoveTemp(*batch), weakThis.Get());
+		});
+	});
+}
+
+void UReplicatedTextureComponent::finishBatch(FCompressedBatch&& batch, UReplicatedTextureComponent* component)
+{
+	TSet<FString> bundled;
+	if (component != nullptr)
+	{
+		for (const FCompressedBundle& bundle : batch.bundles)
+		{
+			bundled.Append(bundle.bundle.names);
+		}
+	}
+
+	for (int32 i = 0; i < batch.names.Num(); i++)
+	{
+		if (!bundled.Contains(batch.names[i]))
+		{
+			finishCompression(batch.names[i], MoveTemp(batch.textures[i]), batch.succeeded[i] && component != nullptr, component);
+			continue;
+		}
+
+		// Announced with its bundle
+		textureStorage->Unpin(batch.names[i]);
+		component->storeCompressed(batch.names[i], MoveTemp(batch.textures[i]));
+	}
+
+	if (component == nullptr) return;
+
+	for (FCompressedBundle& bundle : batch.bundles)
+	{
+		const FString name = bundle.name;
+		component->storeBundle(MoveTemp(bundle));
+		component->announceBundle(name);
+	}
+}
+
+void UReplicatedTextureComponent::finishCompression(const FString& name, FCompressedTexture&& compressed, bool succeed, UReplicatedTextureComponent* component)
+{
+	textureStorage->Unpin(name);
+
+	if (!succeed)
+	{
+		// If failed to compress - abord replication
+		textureStorage->replicatedTextures.Remove(name);
+		textureStorage->loadedTexturesNames.RemoveSingleSwap(name);
+		return;
+	}
+
+	component->storeCompressed(name, MoveTemp(compressed));
+	component->announceTexture(name);
+}
+
+void UReplicatedTextureComponent::announceTexture(const FString& name)
+{
+	const FTextureTransferHeader& header = textureStorage->textureHeaders.FindChecked(name);
+	if (header.patchTarget.IsEmpty())
+	{
+		textureStorage->namesByHash.FindOrAdd(header.contentHash, name);
+	}
+
+	// Kept until the server announces it back
+	if (GetNetMode() == NM_Client)
+	{
+		textureStorage->Pin(name);
+	}
+
+	if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
+	{
+		replicateTextureToAll(name);
+	}
+	else
+	{
+		replicateTextureServer(name, textureStorage->textureHeaders.FindChecked(name));
+	}
+}
+
+
+void UReplicatedTextureComponent::announceBundle(const FString& name)
+{
+	const FTextureBundle& bundle = textureStorage->bundles.FindChecked(name);
+
+	for (int32 i = 0; i < bundle.names.Num(); i++)
+	{
+		textureStorage->namesByHash.FindOrAdd(bundle.headers[i].contentHash, bundle.names[i]);
+
+		// Kept until the server announces the bundle back
+		if (GetNetMode() == NM_Client)
+		{
+			textureStorage->Pin(bundle.names[i]);
+		}
+	}
+
+	if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
+	{
+		replicateBundleToAll(name);
+	}
+	else
+	{
+		replicateBundleServer(name, textureStorage->textureHeaders.FindChecked(name), bundle);
+	}
+}
+
+void UReplicatedTextureComponent::postReplicateTexture(UTexture2D* texture, const FString& name)
+{
+	if (texture != nullptr)
+	{
+		textureStorage->replicatedTextures.Add(name, texture);
+	}
+	else
+	{
+		textureStorage->evictedTextures.Add(name);
+	}
+	textureStorage->loadedTexturesNames.Add(name);
+	textureStorage->Touch(name);
+
+#if !UE_SERVER || UE_EDITOR
+	// Skip dedicated server
+	if (texture != nullptr)
+	{
+		OnTextureReady.Broadcast(name, texture);
+	}
+
+#endif // !UE_SERVER || UE_EDITORe
+
+	// Textures of a bundle are announced with it
+	if ((GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer) && !textureStorage->bundledTextures.Contains(name))
+	{
+		replicateTextureToAll(name);
+	}
+
+	textureStorage->Trim();
+
+	if (namedQueue.IsEmpty() && pendingDecodes == 0)
+	{
+		notifyQueueEmtpy();
+	}
+}
+
+bool UReplicatedTextureComponent::aliasTexture(const FString& name, const FTextureTransferHeader& header)
+{
+	const FString* existingName = textureStorage->namesByHash.Find(header.contentHash);
+	if (existingName == nullptr) return false;
+
+	// Relay server has no textures, only their buffers
+	const TObjectPtr<UTexture2D>* texture = textureStorage->replicatedTextures.Find(*existingName);
+	if (texture == nullptr && !(isRelay() && textureStorage->IsLoaded(*existingName))) return false;
+
+	const FTextureBufferRef* buffer = textureStorage->textureBuffers.Find(*existingName);
+
+	// Atlas slot can't be shared, it is patched separately
+	// The texture gets its own slot decoded from the same buffer
+	if (textureStorage->atlas.Contains(*existingName))
+	{
+		if (buffer == nullptr) return false;
+
+		UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture \"%s\" has the same content as \"%s\", decoding it from its buffer"), *name, **existingName);
+
+		const FTextureBufferRef existingBuffer = *buffer;
+		textureStorage->textureBuffers.Add(name, existingBuffer);
+		textureStorage->textureHeaders.Add(name, header);
+		decodeTransfer(name, header, existingBuffer);
+		return true;
+	}
+
+	UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture \"%s\" has the same content as \"%s\", skipping download"), *name, **existingName);
+
+	if (buffer != nullptr)
+	{
+		textureStorage->textureBuffers.Add(name, *buffer);
+	}
+	textureStorage->textureHeaders.Add(name, header);
+
+	const FTextureTiles* tiles = textureStorage->textureTiles.Find(*existingName);
+	if (tiles != nullptr)
+	{
+		textureStorage->textureTiles.Add(name, *tiles);
+	}
+
+	postReplicateTexture(texture != nullptr ? texture->Get() : nullptr, name);
+	applyPatches(name);
+	return true;
+}
+
+bool UReplicatedTextureComponent::compressImage(const FImage& image, const FString& name, ETextureCodec codec, FCompressedTexture& compressed)
+{
+	// Plain image has no platform data to pass through
+	if (codec == ETextureCodec::Platform)
+	{
+		codec = ETextureCodec::Png;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_TextureReplication_Compress);
+	TRACE_CPUPROFILER_EVENT_SCOPE(ReplicatedTexture::Compress);
+
+	const UReplicatedTextureSettings* settings = GetDefault<UReplicatedTextureSettings>();
+	const ITextureCodec* encoder = FTextureCodecs::Find(codec);
+
+	bool succeed = settings->bProgressive
+		? FTextureCodecs::EncodeProgressive(*encoder, image, settings->progressiveMinSize, compressed.header, compressed.buffer)
+		: encoder->Encode(image, compressed.header, compressed.buffer);
+
+	if (!succeed)
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't compress image \"%s\""), *name);
+		return false;
+	}
+
+	if (!sealCompressed(name, compressed.header, compressed.buffer)) return false;
+
+	hashSourceTiles(image, compressed);
+	return true;
+}
+
+bool UReplicatedTextureComponent::compressFile(TArray64<uint8>&& file, const FImage& image, const FString& name, ETextureCodec codec, FCompressedTexture& compressed)
+{
+	const bool bPng = FTextureCodecs::IsPng(file);
+
+	// Progressive buffer needs downscaled copies, so the file is encoded again
+	if (!bPng || (codec != ETextureCodec::Png && codec != ETextureCodec::Platform) || GetDefault<UReplicatedTextureSettings>()->bProgressive)
+	{
+		return compressImage(image, name, codec, compressed);
+	}
+
+	// Receivers decode it with the same decoder the image came from
+	compressed.header.codec = ETextureCodec::Png;
+	compressed.header.width = image.SizeX;
+	compressed.header.height = image.SizeY;
+	compressed.header.format = image.Format;
+	compressed.header.bSRGB = image.IsGammaCorrected();
+	compressed.header.rawSize = image.RawData.Num();
+	compressed.buffer = MoveTemp(file);
+
+	if (!sealCompressed(name, compressed.header, compressed.buffer)) return false;
+
+	hashSourceTiles(image, compressed);
+	return true;
+}
+
+void UReplicatedTextureComponent::hashSourceTiles(const FImage& image, FCompressedTexture& compressed)
+{
+	if (image.Format != ERawImageFormat::BGRA8) return;
+
+	compressed.tiles.width = image.SizeX;
+	compressed.tiles.height = image.SizeY;
+	FTexturePatches::HashTiles(image.RawData.GetData(), image.SizeX, image.SizeY, compressed.tiles.hashes);
+}
+
+
+bool UReplicatedTextureComponent::compressTexture(UTexture2D* texture, const FString& name, ETextureCodec codec, FCompressedTexture& compressed)
+{
+	// Progressive copies and tiles are made from the source image
+	if (codec != ETextureCodec::Platform)
+	{
+		FImage image;
+		if (!FTextureCodecs::GetSourceImage(texture, image))
+		{
+			UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't get source image \"%s\""), *name);
+			return false;
+		}
+		return compressImage(image, name, codec, compressed);
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_TextureReplication_Compress);
+	TRACE_CPUPROFILER_EVENT_SCOPE(ReplicatedTexture::Compress);
+
+	bool succeed = FTextureCodecs::Find(codec)->EncodeTexture(texture, compressed.header, compressed.buffer);
+
+	// Platform data may be missing, source image is always there
+	if (!succeed)
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("No platform data for \"%s\", falling back to PNG"), *name);
+		succeed = FTextureCodecs::Find(ETextureCodec::Png)->EncodeTexture(texture, compressed.header, compressed.buffer);
+	}
+
+	if (!succeed)
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't compress texture \"%s\""), *name);
+		return false;
+	}
+
+	return sealCompressed(name, compressed.header, compressed.buffer);
+}
+
+bool UReplicatedTextureComponent::sealCompressed(const FString& name, FTextureTransferHeader& header, const TArray64<uint8>& buffer)
+{
+	UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture \"%s\" compressed size = %lld"), *name, buffer.Num());
+
+	if (buffer.Num() > getMaxBufferSize())
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Texture \"%s\" is bigger than max size, it can't be replicated"), *name);
+		return false;
+	}
+
+	header.contentHash = FXxHash64::HashBuffer(buffer.GetData(), buffer.Num()).Hash;
+	header.compressedSize = buffer.Num();
+	header.numChunks = FMath::DivideAndRoundUp<int64>(buffer.Num(), maxChunkSize);
+	return true;
+}
+
+void UReplicatedTextureComponent::storeCompressed(const FString& name, FCompressedTexture&& compressed)
+{
+	textureStorage->textureHeaders.Add(name, compressed.header);
+	textureStorage->textureBuffers.Add(name, MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>(MoveTemp(compressed.buffer)));
+
+	if (!compressed.tiles.hashes.IsEmpty())
+	{
+		textureStorage->textureTiles.Add(name, MoveTemp(compressed.tiles));
+	}
+}
+
+void UReplicatedTextureComponent::storeBundle(FCompressedBundle&& compressed)
+{
+	textureStorage->textureHeaders.Add(compressed.name, compressed.header);
+	textureStorage->textureBuffers.Add(compressed.name, MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>(MoveTemp(compressed.buffer)));
+	textureStorage->AddBundle(compressed.name, compressed.bundle);
+}
+
+int64 UReplicatedTextureComponent::getMaxBufferSize()
+{
+	return (int64)GetDefault<UReplicatedTextureSettings>()->maxTextureSizeMB * 1024 * 1024;
+}
+
+bool UReplicatedTextureComponent::isHeaderValid(const FTextureTransferHeader& header)
+{
+	if (header.codec == ETextureCodec::Default || FTextureCodecs::Find(header.codec) == nullptr)
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Texture uses unknown codec"));
+		return false;
+	}
+
+	if (header.compressedSize <= 0 || header.compressedSize > getMaxBufferSize())
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Texture size %lld is out of allowed range"), header.compressedSize);
+		return false;
+	}
+
+	if (header.width > FTextureCodecs::maxDimension || header.height > FTextureCodecs::maxDimension)
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Texture is %dx%d, bigger than allowed"), header.width, header.height);
+		return false;
+	}
+
+	if (header.segments.Num() > FTextureCodecs::maxSegments) return false;
+
+	int64 segmentsSize = 0;
+	for (const FTextureSegment& segment : header.segments)
+	{
+		if (segment.size <= 0 || segment.width <= 0 || segment.height <= 0
+			|| segment.width > header.width || segment.height > header.height) return false;
+		segmentsSize += segment.size;
+	}
+
+	if (!header.segments.IsEmpty() && segmentsSize != header.compressedSize) return false;
+
+	return header.width > 0 && header.height > 0
+		&& header.numChunks == FMath::DivideAndRoundUp<int64>(header.compressedSize, maxChunkSize);
+}
+
+bool UReplicatedTextureComponent::isBundleValid(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle)
+{
+	if (!FTextureBundles::Validate(name, header, bundle)
+		|| header.numChunks != FMath::DivideAndRoundUp<int64>(header.compressedSize, maxChunkSize))
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Bundle \"%s\" doesn't match its textures"), *name);
+		return false;
+	}
+
+	// Patches are never bundled
+	for (int32 i = 0; i < bundle.names.Num(); i++)
+	{
+		if (!bundle.headers[i].patchTarget.IsEmpty() || !isNameValid(bundle.names[i], bundle.headers[i])
+			|| !isHeaderValid(bundle.headers[i])) return false;
+	}
+
+	return true;
+}
+
+ETextureCodec UReplicatedTextureComponent::resolveCodec(ETextureCodec codec) const
+{
+	const UReplicatedTextureSettings* settings = GetDefault<UReplicatedTextureSettings>();
+
+	if (codec == ETextureCodec::Default && GetNetMode() == NM_DedicatedServer)
+	{
+		codec = settings->dedicatedServerCodec;
+	}
+
+	if (codec == ETextureCodec::Default)
+	{
+		codec = settings->defaultCodec;
+	}
+
+	if (FTextureCodecs::Find(codec) == nullptr)
+	{
+		codec = ETextureCodec::Png;
+	}
+
+	return codec;
+}
+
+bool UReplicatedTextureComponent::replicateTextureServer_Validate(const FString& name, const FTextureTransferHeader& header)
+{
+	return !name.IsEmpty() && isNameValid(name, header) && isHeaderValid(header);
+}
+
+void UReplicatedTextureComponent::replicateTextureServer_Implementation(const FString& name, const FTextureTransferHeader& header)
+{
+	if (isLoaded(name, header))
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Texture with name \"%s\" is already loaded, skipping"), *name);
+		return;
+	}
+
+	if (!header.patchTarget.IsEmpty())
+	{
+		// Another patch of the same version came first
+		if (textureStorage->textureHeaders.Contains(name) || !textureStorage->textureHeaders.Contains(header.patchTarget))
+		{
+			UE_LOG(LogReplicaetdTexture, Warning, TEXT("Patch \"%s\" conflicts with another one or its texture is unknown, skipping"), *name);
+			return;
+		}
+
+		bAllJobsDone = false;
+		textureStorage->textureHeaders.Add(name, header);
+		enqueue(name);
+		return;
+	}
+
+	bAllJobsDone = false;
+
+	// Server already has the same content, no need to ask the owner for it
+	if (aliasTexture(name, header)) return;
+
+	textureStorage->textureHeaders.Add(name, header);
+	enqueue(name);
+
+	UE_LOG(LogReplicaetdTexture, Log, TEXT("Added texture \"%s\" for replication queue"), *name);
+}
+
+void UReplicatedTextureComponent::replicateTextureOwner_Implementation(const FString& name, const FTextureTransferHeader& header)
+{
+	if (isLoaded(name, header))
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Texture with name \"%s\" is already loaded, skipping"), *name);
+
+		// Server has our upload, it can be evicted now
+		textureStorage->Unpin(name);
+
+		if (namedQueue.IsEmpty()) {
+			notifyQueueEmtpy();
+		}
+		return;
+	}
+
+	if (!isNameValid(name, header) || !isHeaderValid(header))
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Texture \"%s\" has invalid header, skipping"), *name);
+		return;
+	}
+
+	if (!header.patchTarget.IsEmpty())
+	{
+		textureStorage->textureHeaders.Add(name, header);
+		if (deferDownload(name, header)) return;
+
+		enqueue(name);
+		return;
+	}
+
+	// Not asking for chunks is the answer for the server
+	if (aliasTexture(name, header)) return;
+
+	textureStorage->textureHeaders.Add(name, header);
+
+	if (deferDownload(name, header) || loadFromDiskCache(name, header)) return;
+
+	enqueue(name);
+
+	UE_LOG(LogReplicaetdTexture, Log, TEXT("Added texture \"%s\" for replication queue"), *name);
+}
+
+bool UReplicatedTextureComponent::replicateBundleServer_Validate(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle)
+{
+	return isBundleValid(name, header, bundle);
+}
+
+void UReplicatedTextureComponent::replicateBundleServer_Implementation(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle)
+{
+	addBundle(name, header, bundle);
+}
+
+void UReplicatedTextureComponent::replicateBundleOwner_Implementation(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle)
+{
+	if (!isBundleValid(name, header, bundle))
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Bundle \"%s\" is invalid, skipping"), *name);
+		return;
+	}
+
+	addBundle(name, header, bundle);
+}
+
+void UReplicatedTextureComponent::addBundle(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle)
+{
+	// Already downloading
+	if (textureStorage->textureHeaders.Contains(name)) return;
+
+	TArray<int32> missing;
+	for (int32 i = 0; i < bundle.names.Num(); i++)
+	{
+		if (isLoaded(bundle.names[i], bundle.headers[i]))
+		{
+			// Server has our upload, it can be evicted now
+			if (GetNetMode() == NM_Client)
+			{
+				textureStorage->Unpin(bundle.names[i]);
+			}
+			continue;
+		}
+
+		if (aliasTexture(bundle.names[i], bundle.headers[i])) continue;
+
+		missing.Add(i);
+	}
+
+	if (missing.IsEmpty())
+	{
+		// Client doesn't keep bundles, its textures have their own buffers
+		if (GetNetMode() == NM_Client)
+		{
+			textureStorage->ForgetBundle(name);
+		}
+
+		if (namedQueue.IsEmpty() && pendingDecodes == 0)
+		{
+			notifyQueueEmtpy();
+		}
+		return;
+	}
+
+	if (GetNetMode() != NM_Client)
+	{
+		bAllJobsDone = false;
+	}
+
+	textureStorage->textureHeaders.Add(name, header);
+	textureStorage->AddBundle(name, bundle);
+
+	for (int32 i : missing)
+	{
+		textureStorage->textureHeaders.Add(bundle.names[i], bundle.headers[i]);
+	}
+
+	if (loadBundleFromDiskCache(name, header)) return;
+
+	enqueue(name);
+
+	UE_LOG(LogReplicaetdTexture, Log, TEXT("Added bundle \"%s\" of %d textures for replication queue"), *name, missing.Num());
+}
+
+bool UReplicatedTextureComponent::replicateChunkServer_Validate(const FReplicatedTextureChunk& chunk, uint64 begin, const FString& textureName)
+{
+	// Chunks asked for before a retry or cancel still arrive, they are dropped by recieveChunk
+	// Only a chunk no client could have sent disconnects it
+	if (chunk.size > maxChunkSize)
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Recieved chunk with size bigger than max"));
+		return false;
+	}
+
+	return true;
+}
+
+void UReplicatedTextureComponent::replicateChunkServer_Implementation(const FReplicatedTextureChunk& chunk, uint64 begin, const FString& textureName)
+{
+	recieveChunk(chunk, begin, textureName);
+}
+
+void UReplicatedTextureComponent::replicateChunkOwner_Implementation(const FReplicatedTextureChunk& chunk, uint64 begin, const FString& textureName)
+{
+	recieveChunk(chunk, begin, textureName);
+}
+
+void UReplicatedTextureComponent::askChunkOwner_Implementation(const FString& name, uint64 begin)
+{
+	addChunkRequest(name, begin);
+}
+
+bool UReplicatedTextureComponent::askChunkServer_Validate(const FString& name, uint64 begin)
+{
+	const FTextureBufferRef* savedBuffer = textureStorage->textureBuffers.Find(name);
+
+	// Could have been forgotten after it was announced, the client is told so
+	if (savedBuffer == nullptr) return true;
+
+	return (*savedBuffer)->IsValidIndex(begin);
+}
+
+void UReplicatedTextureComponent::askChunkServer_Implementation(const FString& name, uint64 begin)
+{
+	// Client can ask only for what it was told about
+	// Relevancy decides what is announced, a started download finishes even if the player moved away
+	if (!textureStorage->bundles.Contains(name) && !announcedTextures.Contains(name))
+	{
+		cancelTransferOwner(name);
+		return;
+	}
+
+	addChunkRequest(name, begin);
+}
+
+void UReplicatedTextureComponent::fetchTextureServer_Implementation(const FString& name)
+{
+	if (!textureStorage->IsLoaded(name) || !isRelevant(name)) return;
+
+	// Client asked for it, so it isn't sent on demand
+	offerTexture(name, true);
+
+	for (const FString& patchName : textureStorage->patches)
+	{
+		const FTextureTransferHeader* patchHeader = textureStorage->textureHeaders.Find(patchName);
+		if (patchHeader != nullptr && patchHeader->patchTarget == name)
+		{
+			offerTexture(patchName, true);
+		}
+	}
+}
+
+void UReplicatedTextureComponent::cancelTransferOwner_Implementation(const FString& name)
+{
+	cancelTransfer(name);
+}
+
+void UReplicatedTextureComponent::cancelTransferServer_Implementation(const FString& name)
+{
+	cancelTransfer(name);
+}
+
+void UReplicatedTextureComponent::cancelTransfer(const FString& name)
+{
+	UE_LOG(LogReplicaetdTexture, Warning, TEXT("Texture \"%s\" doesn't exist on the other side anymore"), *name);
+
+	dropTransfer(name);
+}
+
+void UReplicatedTextureComponent::dropTransfer(const FString& name)
+{
+	activeTransfers.Remove(name);
+	queuedTimes.Remove(name);
+	namedQueue.RemoveSingle(name);
+
+	const FTextureBundle* bundle = textureStorage->bundles.Find(name);
+	if (bundle != nullptr)
+	{
+		for (const FString& texture : bundle->names)
+		{
+			if (!textureStorage->IsLoaded(texture))
+			{
+				textureStorage->textureHeaders.Remove(texture);
+			}
+		}
+		textureStorage->ForgetBundle(name);
+	}
+
+	if (!textureStorage->IsLoaded(name))
+	{
+		textureStorage->textureHeaders.Remove(name);
+	}
+
+	if (namedQueue.IsEmpty() && pendingDecodes == 0)
+	{
+		notifyQueueEmtpy();
+	}
+}
+
+bool UReplicatedTextureComponent::getChunk(const FString& name, uint64 begin, FReplicatedTextureChunk& chunk) const
+{
+	const FTextureBufferRef* savedBuffer = textureStorage->textureBuffers.Find(name);
+	if (savedBuffer == nullptr || !(*savedBuffer)->IsValidIndex(begin)) return false;
+
+	uint64 left = (*savedBuffer)->Num() - begin;
+
+	// No copy here, chunk only references the stored buffer
+	chunk.buffer = *savedBuffer;
+	chunk.offset = begin;
+	chunk.size = FMath::Min(left, maxChunkSize);
+	chunk.checksum = textureStorage->GetChunkChecksum(name, *savedBuffer, begin, chunk.size);
+	return true;
+}
+
+void UReplicatedTextureComponent::sendChunks()
+{
+	if (chunkRequests.IsEmpty()) return;
+
+	UNetConnection* connection = GetOwner()->GetNetConnection();
+	if (connection == nullptr) return;
+
+	// Gameplay replication goes first, textures wait until the connection has room again
+	if (!connection->IsNetReady(false)) return;
+
+	const UActorChannel* channel = connection->FindActorChannelRef(GetOwner());
+	if (channel != nullptr && channel->NumOutRec >= RELIABLE_BUFFER / 2) return;
+
+	const UReplicatedTextureSettings* settings = GetDefault<UReplicatedTextureSettings>();
+	const double now = FPlatformTime::Seconds();
+
+	// Measured speed of the connection lowers the limit from settings
+	const double connectionRate = FMath::Min<double>(settings->connectionKBPerSecond * 1024.0
+		, connection->CurrentNetSpeed * settings->netSpeedShare);
+
+	bandwidth.Refill(connectionRate, now);
+	textureStorage->bandwidth.Refill(settings->serverKBPerSecond * 1024.0, now);
+
+	TSet<FString> cancelled;
+	int32 handled = 0;
+	while (handled < chunkRequests.Num() && bandwidth.CanSend() && textureStorage->bandwidth.CanSend())
+	{
+		const FChunkRequest& request = chunkRequests[handled++];
+
+		FReplicatedTextureChunk chunk;
+		if (!getChunk(request.name, request.begin, chunk))
+		{
+			if (cancelled.Contains(request.name)) continue;
+
+			cancelled.Add(request.name);
+			if (servedTextures.Remove(request.name) > 0)
+			{
+				textureStorage->Unpin(request.name);
+			}
+
+			if (GetNetMode() == NM_Client)
+			{
+				cancelTransferServer(request.name);
+			}
+			else
+			{
+				cancelTransferOwner(request.name);
+			}
+			continue;
+		}
+
+		if (GetNetMode() == NM_Client)
+		{
+			replicateChunkServer(chunk, request.begin, request.name);
+		}
+		else
+		{
+			replicateChunkOwner(chunk, request.begin, request.name);
+		}
+
+		bandwidth.Consume(chunk.size);
+		textureStorage->bandwidth.Consume(chunk.size);
+
+		bytesSent += chunk.size;
+		INC_DWORD_STAT_BY(STAT_TextureReplication_BytesSent, chunk.size);
+		CSV_CUSTOM_STAT(TextureReplication, BytesSent, chunk.size, ECsvCustomStatOp::Accumulate);
+
+		if (textureStorage->IsLoaded(request.name))
+		{
+			textureStorage->Touch(request.name);
+		}
+	}
+
+	chunkRequests.RemoveAt(0, handled, EAllowShrinking::No);
+}
+
+void UReplicatedTextureComponent::releaseServedTextures(double idleTime)
+{
+	const double now = FPlatformTime::Seconds();
+	for (TMap<FString, double>::TIterator it = servedTextures.CreateIterator(); it; ++it)
+	{
+		if (now - it.Value() < idleTime) continue;
+
+		// Retries ask for earlier chunks again after the last one was sent
+		const FString& name = it.Key();
+		if (chunkRequests.ContainsByPredicate([&name](const FChunkRequest& request) { return request.name == name; })) continue;
+
+		textureStorage->Unpin(name);
+		it.RemoveCurrent();
+	}
+}
+
+void UReplicatedTextureComponent::recieveChunk(const FReplicatedTextureChunk& chunk, uint64 begin, const FString& textureName)
+{
+	FTextureTransfer* transfer = activeTransfers.Find(textureName);
+
+	// Asked for when the stream was late, then it came from the stream anyway
+	if (transfer != nullptr && transfer->streamedChunks.Contains(begin) && !transfer->chunksInFlight.Contains(begin))
+	{
+		UE_LOG(LogReplicaetdTexture, Verbose, TEXT("Recieved chunk of \"%s\" at %llu, that was already streamed"), *textureName, begin);
+		return;
+	}
+
+	// Stale chunks of a download that was cancelled or started over end up here too
+	if (transfer == nullptr || !transfer->chunksInFlight.Contains(begin) || begin + chunk.size > transfer->totalSize)
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Recieved chunk of \"%s\" at %llu, that wasn't asked for"), *textureName, begin);
+		return;
+	}
+
+	bytesRecieved += chunk.size;
+	INC_DWORD_STAT_BY(STAT_TextureReplication_BytesRecieved, chunk.size);
+	CSV_CUSTOM_STAT(TextureReplication, BytesRecieved, chunk.size, ECsvCustomStatOp::Accumulate);
+
+	// Every chunk except the last one is full
+	const bool bFits = chunk.size == FMath::Min(maxChunkSize, transfer->totalSize - begin);
+
+	// Damaged chunk or one that doesn't fit is asked for again, it stays in flight
+	if (!bFits || !chunk.IsValid())
+	{
+		numChunkRetries++;
+		INC_DWORD_STAT(STAT_TextureReplication_ChunkRetries);
+		CSV_CUSTOM_STAT(TextureReplication, ChunkRetries, 1, ECsvCustomStatOp::Accumulate);
+
+		if (++transfer->chunkRetries > maxChunkRetries)
+		{
+			UE_LOG(LogReplicaetdTexture, Error, TEXT("Too many damaged chunks of \"%s\", starting over"), *textureName);
+			activeTransfers.Remove(textureName);
+			namedQueue.RemoveSingle(textureName);
+			retryTransfer(textureName);
+			return;
+		}
+
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Recieved %s chunk of \"%s\" at %llu, asking for it again"), bFits ? TEXT("damaged") : TEXT("wrong size")
+			, *textureName, begin);
+		askChunk(textureName, begin);
+		return;
+	}
+
+	FMemory::Memcpy(transfer->buffer.GetData() + begin, chunk.GetData(), chunk.size);
+	acceptChunk(*transfer, begin, chunk.size);
+}
+
+void UReplicatedTextureComponent::RecieveStreamPart(const FString& name, uint64 begin, const FReplicatedTextureChunk& part)
+{
+	if (!IsValid(textureStorage)) return;
+
+	lastStreamPartTime = FPlatformTime::Seconds();
+
+	// Stream may get ahead of the queue, its texture starts downloading right away
+	FTextureTransfer* transfer = activeTransfers.Find(name);
+	if (transfer == nullptr && namedQueue.Contains(name) && textureStorage->textureHeaders.Contains(name))
+	{
+		startTransfer(name);
+		transfer = activeTransfers.Find(name);
+	}
+
+	// Not downloaded by this client, or the offer didn't arrive yet and the chunk is asked for later
+	// Resuming download has no buffer until it's read from disk, the chunk is asked for later too
+	const uint64 partSize = AReplicatedTextureStream::partSize;
+	if (transfer == nullptr || transfer->bResuming || begin % partSize != 0 || begin >= transfer->totalSize) return;
+
+	// Already recieved, either asked for earlier or resumed from disk
+	const uint64 chunkBegin = begin - begin % maxChunkSize;
+	const bool bInFlight = transfer->chunksInFlight.Contains(chunkBegin);
+	if (!bInFlight && (chunkBegin < transfer->nextOffset || transfer->streamedChunks.Contains(chunkBegin))) return;
+
+	if (part.size != FMath::Min(partSize, transfer->totalSize - begin) || !part.IsValid())
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Recieved broken stream part of \"%s\" at %llu, it will be asked for"), *name, begin);
+		return;
+	}
+
+	transfer->lastStreamTime = FPlatformTime::Seconds();
+
+	bytesRecieved += part.size;
+	INC_DWORD_STAT_BY(STAT_TextureReplication_BytesRecieved, part.size);
+	CSV_CUSTOM_STAT(TextureReplication, BytesRecieved, part.size, ECsvCustomStatOp::Accumulate);
+
+	// Written in place, the chunk is counted once all its parts are there
+	FMemory::Memcpy(transfer->buffer.GetData() + begin, part.GetData(), part.size);
+
+	uint8& parts = transfer->streamedParts.FindOrAdd(chunkBegin);
+	parts |= uint8(1 << ((begin - chunkBegin) / partSize));
+
+	const uint64 chunkSize = FMath::Min(maxChunkSize, transfer->totalSize - chunkBegin);
+	const uint8 allParts = uint8((1 << FMath::DivideAndRoundUp(chunkSize, partSize)) - 1);
+	if (parts != allParts) return;
+
+	transfer->streamedChunks.Add(chunkBegin);
+	acceptChunk(*transfer, chunkBegin, chunkSize);
+}
+
+void UReplicatedTextureComponent::acceptChunk(FTextureTransfer& transfer, uint64 begin, int32 size)
+{
+	transfer.chunksInFlight.Remove(begin);
+	transfer.streamedParts.Remove(begin);
+	transfer.receivedSize += size;
+
+	if (transfer.firstChunkTime == 0)
+	{
+		transfer.firstChunkTime = FPlatformTime::Seconds();
+		CSV_CUSTOM_STAT(TextureReplication, TimeToFirstChunkMs, float((transfer.firstChunkTime - transfer.startTime) * 1000.0), ECsvCustomStatOp::Max);
+	}
+
+	decodeProgress(transfer);
+
+	UE_LOG(LogReplicaetdTexture, VeryVerbose, TEXT("Recieving chunk with size %d, (%llu loaded)"), size, transfer.receivedSize);
+
+	if (transfer.receivedSize >= transfer.totalSize)
+	{
+		const double now = FPlatformTime::Seconds();
+		CSV_CUSTOM_STAT(TextureReplication, TimeToLastChunkMs, float((now - transfer.startTime) * 1000.0), ECsvCustomStatOp::Max);
+
+		// Transfer is removed below, its name is copied first
+		const FString name = transfer.name;
+
+		UE_LOG(LogReplicaetdTexture, Log, TEXT("Downloaded \"%s\" in %.2fs, %.2fs in queue, first chunk after %.2fs"), *name
+			, now - transfer.startTime, transfer.startTime - transfer.queuedTime, transfer.firstChunkTime - transfer.startTime);
+
+		FTextureBufferRef buffer = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>(MoveTemp(transfer.buffer));
+		textureStorage->textureBuffers.Add(name, buffer);
+
+		const FTextureTransferHeader header = transfer.header;
+		activeTransfers.Remove(name);
+		namedQueue.RemoveSingle(name);
+
+		verifyTransfer(name, header, buffer);
+	}
+}
+
+void UReplicatedTextureComponent::verifyTransfer(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer)
+{
+	pendingDecodes++;
+
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header, buffer, weakThis, this] {
+		bool succeed = isHashValid(header, *buffer);
+
+		AsyncTask(ENamedThreads::GameThread, [name, header, buffer, succeed, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			pendingDecodes--;
+
+			if (!succeed)
+			{
+				retryTransfer(name);
+				return;
+			}
+
+			transferRetries.Remove(name);
+
+			if (textureStorage->bundles.Contains(name))
+			{
+				unpackBundle(name, header, buffer);
+				return;
+			}
+
+			decodeTransfer(name, header, buffer);
+		});
+	});
+}
+
+void UReplicatedTextureComponent::retryTransfer(const FString& name)
+{
+	textureStorage->textureBuffers.Remove(name);
+
+	numTransferRetries++;
+	INC_DWORD_STAT(STAT_TextureReplication_TransferRetries);
+	CSV_CUSTOM_STAT(TextureReplication, TransferRetries, 1, ECsvCustomStatOp::Accumulate);
+
+	int32& retries = transferRetries.FindOrAdd(name);
+	if (retries++ < maxTransferRetries && textureStorage->textureHeaders.Contains(name))
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Download of \"%s\" is damaged, downloading it again"), *name);
+		enqueue(name);
+		return;
+	}
+
+	UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't download \"%s\", skipping"), *name);
+	transferRetries.Remove(name);
+
+	dropTransfer(name);
+}
+
+void UReplicatedTextureComponent::decodeTransfer(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer, bool bVerified)
+{
+	if (isRelay())
+	{
+		relayBuffer(name, header, buffer, bVerified);
+		return;
+	}
+
+	if (!header.patchTarget.IsEmpty())
+	{
+		decodePatch(name, header, buffer, bVerified);
+		return;
+	}
+
+	pendingDecodes++;
+
+	// Decompress texture nad validate
+	// Remove from buffers, if it's invalid
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header, buffer, bVerified, weakThis, this] {
+
+		TSharedRef<FDecodedTexture, ESPMode::ThreadSafe> decoded = MakeShared<FDecodedTexture, ESPMode::ThreadSafe>();
+		bool succeed = (bVerified || isHashValid(header, *buffer)) && decodeBuffer(header, *buffer, *decoded) && prepareTexture(*decoded);
+
+		AsyncTask(ENamedThreads::GameThread, [name, header, decoded, succeed, buffer, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			pendingDecodes--;
+
+			if (finishDecode(name, *decoded, succeed))
+			{
+				UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture is ready, total compressed size is %lld"), buffer->Num());
+
+				// Bundled textures are cached with their bundle
+				if (GetNetMode() == NM_Client && !textureStorage->bundledTextures.Contains(name))
+				{
+					FReplicatedTextureDiskCache::Get().Save(header.contentHash, buffer);
+				}
+			}
+		});
+	});
+}
+
+void UReplicatedTextureComponent::decodeProgress(FTextureTransfer& transfer)
+{
+	// Last segment is decoded when the whole buffer arrives
+	const int32 numSegments = FTextureCodecs::GetNumSegments(transfer.header);
+	if (numSegments < 2 || transfer.bDecodingSegment) return;
+
+	// Nothing to show on dedicated server
+	if (GetNetMode() == NM_DedicatedServer) return;
+
+	const uint64 contiguous = getContiguousSize(transfer);
+
+	int32 segmentIndex = INDEX_NONE;
+	int64 offset = 0;
+	int64 size = 0;
+	for (int32 i = transfer.segmentsDecoded; i < numSegments - 1; i++)
+	{
+		FTextureCodecs::GetSegment(transfer.header, i, offset, size);
+		if (offset + size > (int64)contiguous) break;
+
+		segmentIndex = i;
+	}
+
+	if (segmentIndex == INDEX_NONE) return;
+
+	const FTextureTransferHeader segmentHeader = FTextureCodecs::GetSegment(transfer.header, segmentIndex, offset, size);
+	const float progress = float(segmentIndex + 1) / numSegments;
+	const FString name = transfer.name;
+
+	// Low resolution segments are small, copy is cheaper than keeping the buffer alive
+	FTextureBufferRef segmentBuffer = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>(transfer.buffer.GetData() + offset, size);
+
+	transfer.segmentsDecoded = segmentIndex + 1;
+	transfer.bDecodingSegment = true;
+
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, segmentHeader, segmentBuffer, progress, weakThis, this] {
+
+		TSharedRef<FDecodedTexture, ESPMode::ThreadSafe> decoded = MakeShared<FDecodedTexture, ESPMode::ThreadSafe>();
+		bool succeed = FTextureCodecs::Find(segmentHeader.codec)->Decode(segmentHeader, *segmentBuffer, *decoded)
+			&& FTextureCodecs::PreparePlatformData(*decoded);
+
+		AsyncTask(ENamedThreads::GameThread, [name, decoded, succeed, progress, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			FTextureTransfer* transfer = activeTransfers.Find(name);
+			if (transfer != nullptr)
+			{
+				transfer->bDecodingSegment = false;
+			}
+
+			// Full texture may be ready already
+			if (!succeed || textureStorage->IsLoaded(name)) return;
+
+			UTexture2D* texture = nullptr;
+			TObjectPtr<UTexture2D>* previous = textureStorage->progressTextures.Find(name);
+			if (previous != nullptr)
+			{
+				texture = FTextureCodecs::UpdateTexture(*previous, *decoded) ? previous->Get() : nullptr;
+			}
+			else
+			{
+				texture = FTextureCodecs::CreateTexture(*decoded);
+				textureStorage->progressTextures.Add(name, texture);
+			}
+
+			if (!IsValid(texture)) return;
+
+#if !UE_SERVER || UE_EDITOR
+			OnTextureProgress.Broadcast(name, texture, progress);
+#endif // !UE_SERVER || UE_EDITOR
+		});
+	});
+}
+
+bool UReplicatedTextureComponent::isHashValid(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer)
+{
+	if (FXxHash64::HashBuffer(buffer.GetData(), buffer.Num()).Hash != header.contentHash)
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Content hash doesn't match the header"));
+		return false;
+	}
+
+	return true;
+}
+
+bool UReplicatedTextureComponent::isNameValid(const FString& name, const FTextureTransferHeader& header)
+{
+	const FString separator = FString::Chr(FTexturePatches::separator);
+
+	if (header.patchTarget.IsEmpty()) return !name.Contains(separator);
+
+	return !header.patchTarget.Contains(separator) && header.version == header.baseVersion + 1
+		&& header.baseVersion >= 0 && name == FTexturePatches::GetPatchName(header.patchTarget, header.version);
+}
+
+bool UReplicatedTextureComponent::isLoaded(const FString& name, const FTextureTransferHeader& header) const
+{
+	return header.patchTarget.IsEmpty()
+		? textureStorage->replicatedTextures.Contains(name)
+		: textureStorage->patches.Contains(name);
+}
+
+bool UReplicatedTextureComponent::decodeBuffer(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedTexture& decoded)
+{
+	SCOPE_CYCLE_COUNTER(STAT_TextureReplication_Decode);
+	TRACE_CPUPROFILER_EVENT_SCOPE(ReplicatedTexture::Decode);
+
+	// Only the full size segment is needed here
+	int64 offset = 0;
+	int64 size = 0;
+	const FTextureTransferHeader segmentHeader = FTextureCodecs::GetSegment(header, FTextureCodecs::GetNumSegments(header) - 1, offset, size);
+
+	if (!FTextureCodecs::Find(header.codec)->Decode(segmentHeader, buffer.Slice(offset, size), decoded)) return false;
+
+	if (decoded.format == PF_B8G8R8A8)
+	{
+		FTexturePatches::HashTiles(decoded.pixels.GetData(), decoded.width, decoded.height, decoded.tileHashes);
+	}
+
+	return true;
+}
+
+bool UReplicatedTextureComponent::prepareTexture(FDecodedTexture& decoded)
+{
+	if (FTextureAtlas::CanAdd(decoded)) return true;
+
+	if (FTextureBlockCompression::CanCompress(decoded))
+	{
+		SCOPE_CYCLE_COUNTER(STAT_TextureReplication_BlockCompress);
+		TRACE_CPUPROFILER_EVENT_SCOPE(ReplicatedTexture::BlockCompress);
+
+		FTextureBlockCompression::Compress(decoded);
+	}
+
+	return FTextureCodecs::PreparePlatformData(decoded);
+}
+
+UTexture2D* UReplicatedTextureComponent::createTexture(const FString& name, FDecodedTexture& decoded)
+{
+	if (FTextureAtlas::CanAdd(decoded))
+	{
+		UTexture2D* page = textureStorage->atlas.Add(name, decoded);
+		if (IsValid(page)) return page;
+	}
+
+	return FTextureCodecs::CreateTexture(decoded);
+}
+
+bool UReplicatedTextureComponent::finishDecode(const FString& name, FDecodedTexture& decoded, bool decodeSucceed)
+{
+	UTexture2D* texture = nullptr;
+	TObjectPtr<UTexture2D> progressTexture;
+
+	// Progressive texture is updated in place, so everyone holding it gets full size
+	if (textureStorage->progressTextures.RemoveAndCopyValue(name, progressTexture) && decodeSucceed
+		&& FTextureCodecs::UpdateTexture(progressTexture, decoded))
+	{
+		texture = progressTexture;
+	}
+	else if (decodeSucceed)
+	{
+		texture = createTexture(name, decoded);
+	}
+
+	if (!IsValid(texture))
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't decompress a texture for some reason"));
+		textureStorage->textureBuffers.Remove(name);
+		textureStorage->textureHeaders.Remove(name);
+		return false;
+	}
+
+	if (!decoded.tileHashes.IsEmpty())
+	{
+		FTextureTiles& tiles = textureStorage->textureTiles.Add(name);
+		tiles.width = decoded.width;
+		tiles.height = decoded.height;
+		tiles.hashes = decoded.tileHashes;
+	}
+
+	textureStorage->namesByHash.FindOrAdd(textureStorage->textureHeaders.FindChecked(name).contentHash, name);
+	postReplicateTexture(texture, name);
+
+	// Patches which came before the texture itself
+	applyPatches(name);
+	return true;
+}
+
+bool UReplicatedTextureComponent::isRelay() const
+{
+	return GetNetMode() == NM_DedicatedServer && GetDefault<UReplicatedTextureSettings>()->bRelayOnDedicatedServer;
+}
+
+void UReplicatedTextureComponent::relayBuffer(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer, bool bVerified)
+{
+	pendingDecodes++;
+
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header, buffer, bVerified, weakThis, this] {
+
+		// Receivers decode it, so only what they rely on before decoding is checked here
+		bool succeed = (bVerified || isHashValid(header, *buffer)) && (header.patchTarget.IsEmpty()
+			? FTextureCodecs::Validate(header, *buffer)
+			: FTexturePatches::Validate(header));
+
+		AsyncTask(ENamedThreads::GameThread, [name, header, succeed, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			pendingDecodes--;
+
+			if (!succeed)
+			{
+				UE_LOG(LogReplicaetdTexture, Error, TEXT("Recieved buffer \"%s\" doesn't match its header"), *name);
+				textureStorage->textureBuffers.Remove(name);
+				textureStorage->textureHeaders.Remove(name);
+			}
+			else if (header.patchTarget.IsEmpty())
+			{
+				textureStorage->namesByHash.FindOrAdd(header.contentHash, name);
+				postReplicateTexture(nullptr, name);
+				return;
+			}
+			else
+			{
+				textureStorage->patches.Add(name);
+				int32& version = textureStorage->textureVersions.FindOrAdd(header.patchTarget);
+				version = FMath::Max(version, header.version);
+
+				replicateTextureToAll(name);
+				textureStorage->Trim();
+			}
+
+			if (namedQueue.IsEmpty() && pendingDecodes == 0)
+			{
+				notifyQueueEmtpy();
+			}
+		});
+	});
+}
+
+void UReplicatedTextureComponent::unpackBundle(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer)
+{
+	pendingDecodes++;
+
+	const FTextureBundle bundle = textureStorage->bundles.FindChecked(name);
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header, bundle, buffer, weakThis, this] {
+
+		// Its hash is checked when the download finishes
+		TArray<FTextureBufferRef> buffers;
+		bool succeed = FTextureBundles::Unpack(bundle, *buffer, buffers);
+
+		AsyncTask(ENamedThreads::GameThread, [name, bundle, buffers, succeed, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			pendingDecodes--;
+			finishBundle(name, bundle, buffers, succeed);
+		});
+	});
+}
+
+bool UReplicatedTextureComponent::loadBundleFromDiskCache(const FString& name, const FTextureTransferHeader& header)
+{
+	if (GetNetMode() != NM_Client || !FReplicatedTextureDiskCache::Get().IsEnabled()) return false;
+
+	pendingDecodes++;
+
+	const FTextureBundle bundle = textureStorage->bundles.FindChecked(name);
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header, bundle, weakThis, this] {
+
+		TSharedPtr<FMappedTextureBuffer, ESPMode::ThreadSafe> cached = FReplicatedTextureDiskCache::Get().Load(header.contentHash);
+		const bool bCached = cached.IsValid();
+
+		TArray<FTextureBufferRef> buffers;
+		bool succeed = bCached && isHashValid(header, cached->GetView()) && FTextureBundles::Unpack(bundle, cached->GetView(), buffers);
+
+		AsyncTask(ENamedThreads::GameThread, [name, header, bundle, buffers, succeed, bCached, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			pendingDecodes--;
+
+			if (succeed)
+			{
+				UE_LOG(LogReplicaetdTexture, Log, TEXT("Loaded bundle \"%s\" from disk cache"), *name);
+				finishBundle(name, bundle, buffers, succeed);
+				return;
+			}
+
+			// Cached file is broken, download the bundle instead
+			if (bCached)
+			{
+				FReplicatedTextureDiskCache::Get().Remove(header.contentHash);
+			}
+			enqueue(name);
+		});
+	});
+
+	return true;
+}
+
+void UReplicatedTextureComponent::finishBundle(const FString& name, const FTextureBundle& bundle, const TArray<FTextureBufferRef>& buffers, bool unpackSucceed)
+{
+	if (!unpackSucceed)
+	{
+		UE_LOG(LogReplicaetdTexture, Error, TEXT("Recieved bundle \"%s\" doesn't match its header"), *name);
+
+		for (const FString& texture : bundle.names)
+		{
+			if (!textureStorage->IsLoaded(texture))
+			{
+				textureStorage->textureHeaders.Remove(texture);
+			}
+		}
+		textureStorage->ForgetBundle(name);
+	}
+	else
+	{
+		if (GetNetMode() == NM_Client)
+		{
+			// Textures keep their own buffers, the bundle is only cached on disk
+			const FTextureBufferRef* buffer = textureStorage->textureBuffers.Find(name);
+			if (buffer != nullptr)
+			{
+				FReplicatedTextureDiskCache::Get().Save(textureStorage->textureHeaders.FindChecked(name).contentHash, *buffer);
+			}
+			textureStorage->textureBuffers.Remove(name);
+			textureStorage->textureHeaders.Remove(name);
+		}
+		else
+		{
+			// Receivers check each texture when they decode it
+			replicateBundleToAll(name);
+		}
+
+		for (int32 i = 0; i < bundle.names.Num(); i++)
+		{
+			const FString& texture = bundle.names[i];
+
+			// Loaded meanwhile or forgotten
+			if (textureStorage->IsLoaded(texture) || !textureStorage->textureHeaders.Contains(texture)) continue;
+
+			// Bundle hash doesn't cover the hashes its headers claim
+			textureStorage->textureBuffers.Add(texture, buffers[i]);
+			decodeTransfer(texture, bundle.headers[i], buffers[i], false);
+		}
+	}
+
+	if (namedQueue.IsEmpty() && pendingDecodes == 0)
+	{
+		notifyQueueEmtpy();
+	}
+}
+
+void UReplicatedTextureComponent::decodePatch(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer, bool bVerified)
+{
+	pendingDecodes++;
+
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header, buffer, bVerified, weakThis, this] {
+
+		TSharedRef<FDecodedPatch, ESPMode::ThreadSafe> patch = MakeShared<FDecodedPatch, ESPMode::ThreadSafe>();
+		bool succeed = (bVerified || isHashValid(header, *buffer)) && FTexturePatches::Decode(header, *buffer, *patch);
 
-	if (bPauseReplication) return;
+		AsyncTask(ENamedThreads::GameThread, [name, header, patch, succeed, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
+
+			pendingDecodes--;
+
+			if (succeed)
+			{
+				textureStorage->patches.Add(name);
+				textureStorage->pendingPatches.FindOrAdd(header.patchTarget).Add(patch);
+				applyPatches(header.patchTarget);
+
+				if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
+				{
+					replicateTextureToAll(name);
+				}
+
+				textureStorage->Trim();
+			}
+			else
+			{
+				UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't decompress patch \"%s\""), *name);
+				textureStorage->textureBuffers.Remove(name);
+				textureStorage->textureHeaders.Remove(name);
+			}
+
+			if (namedQueue.IsEmpty() && pendingDecodes == 0)
+			{
+				notifyQueueEmtpy();
+			}
+		});
+	});
+}
+
+void UReplicatedTextureComponent::applyPatches(const FString& name)
+{
+	TArray<TSharedRef<FDecodedPatch, ESPMode::ThreadSafe>>* pending = textureStorage->pendingPatches.Find(name);
+
+	// Base texture must be loaded first
+	if (pending == nullptr || !textureStorage->IsLoaded(name)) return;
 
-	if (!isDownloading && !namedQueue.IsEmpty())
+	int32 version = textureStorage->textureVersions.FindRef(name);
+	while (true)
 	{
-		currentDownloadName = namedQueue[0];
+		const int32 index = pending->IndexOfByPredicate([version](const TSharedRef<FDecodedPatch, ESPMode::ThreadSafe>& patch) {
+			return patch->baseVersion == version;
+		});
+		if (index == INDEX_NONE) break;
 
-		UE_LOG(LogReplicaetdTexture, Log, TEXT("Started downloadning texture \"%s\""), *currentDownloadName);
+		TSharedRef<FDecodedPatch, ESPMode::ThreadSafe> patch = (*pending)[index];
+		pending->RemoveAtSwap(index);
 
-		isDownloading = true;
-		chunkReady = true;
-		textureStorage->textureBuffers.Add(currentDownloadName, TArray<uint8>());
+		applyPatch(name, *patch);
+		version = patch->version;
 	}
 
-	if (isDownloading && chunkReady)
+	textureStorage->textureVersions.Add(name, version);
+
+	// Older ones will never apply
+	pending->RemoveAll([version](const TSharedRef<FDecodedPatch, ESPMode::ThreadSafe>& patch) {
+		return patch->baseVersion < version;
+	});
+
+	if (pending->IsEmpty())
 	{
-		uint64 begin = textureStorage->textureBuffers.Find(currentDownloadName)->Num();
-		if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
-		{
-			askChunkOwner(currentDownloadName, begin);
-		}
-		if (GetNetMode() == NM_Client)
-		{
-			askChunkServer(currentDownloadName, begin);
-		}
-		chunkReady = false;
+		textureStorage->pendingPatches.Remove(name);
 	}
 }
 
-void UReplicatedTextureComponent::GetLifetimeReplicatedProps(TArray< FLifetimeProperty >& OutLifetimeProps) const
+void UReplicatedTextureComponent::applyPatch(const FString& name, const FDecodedPatch& patch)
 {
-	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
-	DOREPLIFETIME(UReplicatedTextureComponent, bAllJobsDone);
-}
+	// Content doesn't match its hash anymore, nothing should be aliased to it
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	if (header != nullptr && textureStorage->namesByHash.FindRef(header->contentHash) == name)
+	{
+		textureStorage->namesByHash.Remove(header->contentHash);
+	}
 
+	FTextureTiles* tiles = textureStorage->textureTiles.Find(name);
+	if (tiles != nullptr)
+	{
+		FTexturePatches::UpdateHashes(patch, tiles->hashes);
+	}
 
-void UReplicatedTextureComponent::fetchTextures_Implementation()
-{
-	UE_LOG(LogReplicaetdTexture, Log, TEXT("Fetching textures(%d)")
-	, textureStorage->loadedTexturesNames.Num());
+	// Evicted texture gets its patches when it is reloaded
+	TObjectPtr<UTexture2D>* found = textureStorage->replicatedTextures.Find(name);
+	if (found == nullptr) return;
 
-	for (const FString& name : textureStorage->loadedTexturesNames)
+	TObjectPtr<UTexture2D>& texture = *found;
+
+	// Atlas slots are never shared, only the page is
+	FIntRect slot;
+	const bool bAtlas = textureStorage->atlas.FindRect(name, slot);
+
+	// Aliased names keep the old content
+	for (const TPair<FString, TObjectPtr<UTexture2D>>& pair : textureStorage->replicatedTextures)
 	{
-		replicateTextureOwner(name);
-	}
-}
+		if (bAtlas || pair.Key == name || pair.Value != texture) continue;
 
-bool UReplicatedTextureComponent::ReplicateTexrure(UTexture2D* texture, const FString& name)
-{
-	if (!shouldReplicateTexture(name)) return false;
+		UTexture2D* copy = FTexturePatches::CopyTexture(texture);
+		if (IsValid(copy))
+		{
+			texture = copy;
+		}
+		break;
+	}
 
-	preReplicateTexture(texture, name);
-	beginReplicateTexture(name);
+	if (bAtlas ? !FTexturePatches::Apply(texture, patch, slot) : !FTexturePatches::Apply(texture, patch))
+	{
+		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Couldn't apply patch %d to texture \"%s\""), patch.version, *name);
+		return;
+	}
 
-	return true;
+#if !UE_SERVER || UE_EDITOR
+	OnTextureUpdated.Broadcast(name, texture);
+#endif // !UE_SERVER || UE_EDITOR
 }
 
-bool UReplicatedTextureComponent::ReplicateTexrureFromFile(const FString& path, const FString& name)
+void UReplicatedTextureComponent::reloadTextures()
 {
-	if (!shouldReplicateTexture(name)) return false;
+	if (textureStorage->reloadRequests.IsEmpty()) return;
 
-	FImage img;
-	if (!FImageUtils::LoadImage(*path, img))
+	// Nothing is decoded on relay server
+	if (isRelay())
 	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Failed to load image from file %s"), *path);
-		return false;
+		textureStorage->reloadRequests.Reset();
+		return;
 	}
 
-	UTexture2D* texture = FImageUtils::CreateTexture2DFromImage(img);
+	TSet<FString> requests = MoveTemp(textureStorage->reloadRequests);
+	textureStorage->reloadRequests.Reset();
 
-	if (!IsValid(texture))
+	for (const FString& name : requests)
 	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Failed to create texture from image %s"), *path);
-		return false;
+		reloadTexture(name);
 	}
-
-	preReplicateTexture(texture, name);
-	beginReplicateSource(name, img);
-	
-	return true;
 }
 
-bool UReplicatedTextureComponent::shouldReplicateTexture(const FString& name)
+void UReplicatedTextureComponent::reloadTexture(const FString& name)
 {
-	if (GetNetMode() == NM_Standalone) return false;
+	const FTextureBufferRef* buffer = textureStorage->textureBuffers.Find(name);
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	const int32 version = textureStorage->textureVersions.FindRef(name);
 
-	if (name.IsEmpty())
+	// Patches are applied to the pixels before the texture is created
+	TArray<TPair<FTextureTransferHeader, FTextureBufferRef>> patchBuffers;
+	for (const FString& patchName : textureStorage->patches)
 	{
-		UE_LOG(LogReplicaetdTexture, Warning, TEXT("To replicate texture name must be not emtpy!"), *name);
-		return false;
+		const FTextureTransferHeader* patchHeader = textureStorage->textureHeaders.Find(patchName);
+		const FTextureBufferRef* patchBuffer = textureStorage->textureBuffers.Find(patchName);
+
+		if (patchHeader != nullptr && patchBuffer != nullptr && patchHeader->patchTarget == name && patchHeader->version <= version)
+		{
+			patchBuffers.Emplace(*patchHeader, *patchBuffer);
+		}
 	}
 
-	if (textureStorage->replicatedTextures.Contains(name))
+	if (buffer == nullptr || header == nullptr || patchBuffers.Num() != version)
 	{
-		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Can not replicate texture with name \"%s\", it is already replicated"), *name);
-		return false;
+		// Client can download it again, server has nothing left to decode it from
+		if (GetNetMode() == NM_Client)
+		{
+			textureStorage->Forget(name);
+			fetchTextureServer(name);
+		}
+		return;
 	}
 
-	return true;
-}
+	patchBuffers.Sort([](const TPair<FTextureTransferHeader, FTextureBufferRef>& a, const TPair<FTextureTransferHeader, FTextureBufferRef>& b) {
+		return a.Key.version < b.Key.version;
+	});
 
+	textureStorage->reloading.Add(name);
 
-void UReplicatedTextureComponent::preReplicateTexture(UTexture2D* texture, const FString& name)
-{
-	textureStorage->replicatedTextures.Add(name, texture);
-	textureStorage->loadedTexturesNames.Add(name);
-}
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header = *header, buffer = *buffer, patchBuffers, version, weakThis, this] {
 
-void UReplicatedTextureComponent::beginReplicateTexture(const FString& name)
-{
-	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, this] {
-		bool succeed = compressTexture(name);
-		
-		AsyncTask(ENamedThreads::GameThread, [name, this, succeed] {
-			if(!succeed)
+		TSharedRef<FDecodedTexture, ESPMode::ThreadSafe> decoded = MakeShared<FDecodedTexture, ESPMode::ThreadSafe>();
+		bool succeed = decodeBuffer(header, *buffer, *decoded);
+
+		for (const TPair<FTextureTransferHeader, FTextureBufferRef>& patchBuffer : patchBuffers)
+		{
+			FDecodedPatch patch;
+			succeed = succeed && FTexturePatches::Decode(patchBuffer.Key, *patchBuffer.Value, patch)
+				&& FTexturePatches::ApplyToPixels(patch, decoded->pixels);
+		}
+		succeed = succeed && prepareTexture(*decoded);
+
+		AsyncTask(ENamedThreads::GameThread, [name, decoded, succeed, version, weakThis, this] {
+			if (!IsValid(textureStorage)) return;
+
+			textureStorage->reloading.Remove(name);
+			if (!weakThis.IsValid()) return;
+
+			// Forgotten or already loaded
+			if (!textureStorage->evictedTextures.Contains(name)) return;
+
+			// Patched while it was decoded
+			if (textureStorage->textureVersions.FindRef(name) != version)
 			{
-				// If failed to compress - abord replication
-				textureStorage->replicatedTextures.Remove(name);
-				textureStorage->loadedTexturesNames.RemoveSingleSwap(name);
+				textureStorage->RequestReload(name);
 				return;
 			}
 
-			if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
+			UTexture2D* texture = succeed ? createTexture(name, *decoded) : nullptr;
+			if (!IsValid(texture))
 			{
-				replicateTextureToAll(name);
-			}
-			else
-			{
-				replicateTextureServer(name);
+				UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't reload texture \"%s\""), *name);
+				return;
 			}
+
+			textureStorage->evictedTextures.Remove(name);
+			textureStorage->replicatedTextures.Add(name, texture);
+			textureStorage->Touch(name);
+
+#if !UE_SERVER || UE_EDITOR
+			OnTextureReady.Broadcast(name, texture);
+#endif // !UE_SERVER || UE_EDITOR
+
+			textureStorage->Trim();
 		});
 	});
 }
 
-void UReplicatedTextureComponent::beginReplicateSource(const FString& name, const FImage& source)
+bool UReplicatedTextureComponent::loadFromDiskCache(const FString& name, const FTextureTransferHeader& header)
 {
-	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, source, this] {
-		bool succeed = compressImage(source, name);
+	if (GetNetMode() != NM_Client || !FReplicatedTextureDiskCache::Get().IsEnabled()) return false;
 
-		AsyncTask(ENamedThreads::GameThread, [name, this, succeed] {
-			if (!succeed)
-			{
-				// If failed to compress - abord replication
-				textureStorage->replicatedTextures.Remove(name);
-				textureStorage->loadedTexturesNames.RemoveSingleSwap(name);
-				return;
-			}
+	pendingDecodes++;
 
-			if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
-			{
-				replicateTextureToAll(name);
-			}
-			else
-			{
-				replicateTextureServer(name);
-			}
-			});
-		});
-}
+	TWeakObjectPtr<UReplicatedTextureComponent> weakThis(this);
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [name, header, weakThis, this] {
 
+		// Opening the file touches the disk, so it's done here too
+		TSharedPtr<FMappedTextureBuffer, ESPMode::ThreadSafe> cached = FReplicatedTextureDiskCache::Get().Load(header.contentHash);
+		const bool bCached = cached.IsValid();
 
-void UReplicatedTextureComponent::postReplicateTexture(UTexture2D* texture, const FString& name)
-{
-	textureStorage->replicatedTextures.Add(name, texture);
-	textureStorage->loadedTexturesNames.Add(name);
+		// Decoded straight from the mapped file, nothing is copied
+		TSharedRef<FDecodedTexture, ESPMode::ThreadSafe> decoded = MakeShared<FDecodedTexture, ESPMode::ThreadSafe>();
+		bool succeed = bCached && isHashValid(header, cached->GetView()) && decodeBuffer(header, cached->GetView(), *decoded)
+			&& prepareTexture(*decoded);
 
-#if !UE_SERVER || UE_EDITOR
-	// Skip dedicated server
-	OnTextureReady.Broadcast(name, texture);
+		AsyncTask(ENamedThreads::GameThread, [name, header, decoded, succeed, bCached, weakThis, this] {
+			if (!weakThis.IsValid() || !IsValid(textureStorage)) return;
 
-#endif // !UE_SERVER || UE_EDITORe
+			pendingDecodes--;
 
-	if (GetNetMode() == NM_ListenServer || GetNetMode() == NM_DedicatedServer)
-	{
-		replicateTextureToAll(name);
-	}
+			if (bCached)
+			{
+				UE_LOG(LogReplicaetdTexture, Log, TEXT("Loaded texture \"%s\" from disk cache"), *name);
+				if (finishDecode(name, *decoded, succeed)) return;
 
-	if (namedQueue.IsEmpty())
-	{
-		notifyQueueEmtpy();
-	}
+				// Cached file is broken, download the texture instead
+				FReplicatedTextureDiskCache::Get().Remove(header.contentHash);
+				textureStorage->textureHeaders.Add(name, header);
+			}
+
+			enqueue(name);
+		});
+	});
+
+	return true;
 }
 
-bool UReplicatedTextureComponent::compressImage(const FImage& image, const FString& name)
+void UReplicatedTextureComponent::replicateTextureToAll(const FString& name)
 {
-	TArray64<uint8> buffer;
-	if (!FImageUtils::CompressImage(buffer, TEXT("png"), image, -5))
+	// Pushed before the offers, so they can tell clients it's streamed
+	AReplicatedTextureStream* stream = getStream();
+	if (stream != nullptr && isStreamable(name))
 	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't compress image \"%s\""), *name);
-		return false;
+		stream->Push(name);
 	}
 
-	UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture \"%s\" compressed size = %d"), *name, buffer.Num());
-
-	textureStorage->textureBuffers.Add(name, (TArray<uint8>)buffer);
-	return true;
+	// Uploader always gets it back, that's how it knows the server has it
+	for (UReplicatedTextureComponent* repl : getPlayerComponents())
+	{
+		repl->offerTexture(name, repl == this);
+	}
 }
 
-
-bool UReplicatedTextureComponent::compressTexture(const FString& name)
+void UReplicatedTextureComponent::replicateBundleToAll(const FString& name)
 {
-	TObjectPtr<UTexture2D>* texture = textureStorage->replicatedTextures.Find(name);
-
-	FImage image;
-	if (!FImageUtils::GetTexture2DSourceImage(texture->Get(), image))
+	AReplicatedTextureStream* stream = getStream();
+	const FTextureBundle* bundle = textureStorage->bundles.Find(name);
+	if (stream != nullptr && bundle != nullptr && !bundle->names.ContainsByPredicate([this](const FString& texture) { return !isStreamable(texture); }))
 	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't get source image \"%s\""), *name);
-		return false;
+		stream->Push(name);
 	}
 
-
-	TArray64<uint8> buffer;
-	if (!FImageUtils::CompressImage(buffer, TEXT("png"), image, -5))
+	for (UReplicatedTextureComponent* repl : getPlayerComponents())
 	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't compress image \"%s\""), *name);
-		return false;
+		repl->offerBundle(name, repl == this);
 	}
+}
 
-	UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture \"%s\" compressed size = %d"), *name, buffer.Num());
+bool UReplicatedTextureComponent::isRelevant(const FString& name) const
+{
+	// Patches follow their texture
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	const FString& target = header != nullptr && !header->patchTarget.IsEmpty() ? header->patchTarget : name;
 
-	textureStorage->textureBuffers.Add(name, (TArray<uint8>)buffer);
-	return true;
+	const FTextureRelevancy* relevancy = textureStorage->relevancy.Find(target);
+	return relevancy == nullptr || relevancy->IsRelevant(Cast<APlayerController>(GetOwner()));
 }
 
-bool UReplicatedTextureComponent::replicateTextureServer_Validate(const FString& name)
+bool UReplicatedTextureComponent::isOnDemand(const FString& name) const
 {
-	return !name.IsEmpty();
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	const FString& target = header != nullptr && !header->patchTarget.IsEmpty() ? header->patchTarget : name;
+
+	const FTextureRelevancy* relevancy = textureStorage->relevancy.Find(target);
+	return relevancy != nullptr ? relevancy->bOnDemand : GetDefault<UReplicatedTextureSettings>()->bPullOnDemand;
 }
 
-void UReplicatedTextureComponent::replicateTextureServer_Implementation(const FString& name)
+AReplicatedTextureStream* UReplicatedTextureComponent::getStream() const
 {
-	if (textureStorage->replicatedTextures.Contains(name))
+	if (!GetDefault<UReplicatedTextureSettings>()->bSharedStream || GetNetMode() == NM_Client) return nullptr;
+
+	if (!IsValid(textureStorage->stream))
 	{
-		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Texture with name \"%s\" is already loaded, skipping"), *name);
-		return;
+		textureStorage->stream = GetWorld()->SpawnActor<AReplicatedTextureStream>();
 	}
 
-	bAllJobsDone = false;
+	return textureStorage->stream;
+}
 
-	namedQueue.AddUnique(name);
+bool UReplicatedTextureComponent::isStreamable(const FString& name) const
+{
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	const FString& target = header != nullptr && !header->patchTarget.IsEmpty() ? header->patchTarget : name;
 
-	UE_LOG(LogReplicaetdTexture, Log, TEXT("Added texture \"%s\" for replication queue"), *name);
+	return !textureStorage->relevancy.Contains(target) && !GetDefault<UReplicatedTextureSettings>()->bPullOnDemand;
 }
 
-void UReplicatedTextureComponent::replicateTextureOwner_Implementation(const FString& name)
+void UReplicatedTextureComponent::offerTexture(const FString& name, bool bForce)
 {
-	if (textureStorage->replicatedTextures.Contains(name))
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	if (header == nullptr || (!bForce && !isRelevant(name))) return;
+
+	FTextureTransferHeader offered = *header;
+	offered.bOnDemand = !bForce && isOnDemand(name);
+	offered.bStreamed = !offered.bOnDemand && IsValid(textureStorage->stream) && textureStorage->stream->IsStreaming(name);
+
+	// Client won't download it now, so it has no job to finish
+	if (!offered.bOnDemand)
 	{
-		UE_LOG(LogReplicaetdTexture, Warning, TEXT("Texture with name \"%s\" is already loaded, skipping"), *name);
-		if (namedQueue.IsEmpty()) {
-			notifyQueueEmtpy();
-		}
-		return;
+		bClientJobDone = false;
+		bAllJobsDone = false;
 	}
 
-	namedQueue.AddUnique(name);
-
-	UE_LOG(LogReplicaetdTexture, Log, TEXT("Added texture \"%s\" for replication queue"), *name);
+	announcedTextures.Add(name);
+	replicateTextureOwner(name, offered);
 }
 
-
-bool UReplicatedTextureComponent::replicateChunkServer_Validate(const TArray<uint8>& chunk, bool end, const FString& textureName)
+void UReplicatedTextureComponent::offerBundle(const FString& name, bool bForce)
 {
-	if (!textureStorage->textureBuffers.Contains(textureName))
-	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Recieved buffer with name \"%s\", but it doesn't exist."), *textureName);
-		return false;
-	}
+	const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+	const FTextureBundle* bundle = textureStorage->bundles.Find(name);
+	if (header == nullptr || bundle == nullptr) return;
 
-	if (chunk.Num() > maxChunkSize)
+	for (const FString& texture : bundle->names)
 	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Recieved chunk with size bigger than max"));
-		return false;
-	}
+		if (bForce) break;
 
-	if (textureStorage->textureBuffers.Find(textureName)->Num() + chunk.Num() > maxBufferSize)
-	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Buffer is bigger than max"));
-		return false;
+		// Each client gets what is relevant for it one by one
+		if (!isRelevant(texture) || isOnDemand(texture))
+		{
+			for (const FString& offered : bundle->names)
+			{
+				offerTexture(offered);
+			}
+			return;
+		}
 	}
 
-	if (textureStorage->replicatedTextures.Contains(textureName))
-	{
-		UE_LOG(LogReplicaetdTexture, Error, TEXT("Recieved buffer with name \"%s\", but it is already loaded."), *textureName);
-		return false;
-	}
+	bClientJobDone = false;
+	bAllJobsDone = false;
 
-	return true;
-}
+	FTextureTransferHeader offered = *header;
+	offered.bStreamed = IsValid(textureStorage->stream) && textureStorage->stream->IsStreaming(name);
 
-void UReplicatedTextureComponent::replicateChunkServer_Implementation(const TArray<uint8>& chunk, bool end, const FString& textureName)
-{
-	recieveChunk(chunk, end, textureName);
+	announcedTextures.Append(bundle->names);
+	replicateBundleOwner(name, offered, *bundle);
 }
 
-void UReplicatedTextureComponent::replicateChunkOwner_Implementation(const TArray<uint8>& chunk, bool end, const FString& textureName)
+void UReplicatedTextureComponent::updateRelevancy()
 {
-	recieveChunk(chunk, end, textureName);
-}
+	if (textureStorage->relevancy.IsEmpty()) return;
 
-void UReplicatedTextureComponent::askChunkOwner_Implementation(const FString& name, uint64 begin)
-{
-	TArray<uint8> chunk;
-	uint64 left = getChunk(name, begin, chunk);
-	replicateChunkServer(chunk, left <= 0, name);
-	//UE_LOG(LogReplicaetdTexture, Warning, TEXT("Sending chunk with size %04d"), chunk.Num());
-}
+	const APlayerController* player = Cast<APlayerController>(GetOwner());
+	if (player == nullptr || player->IsLocalController()) return;
 
-bool UReplicatedTextureComponent::askChunkServer_Validate(const FString& name, uint64 begin)
-{
-	if (!textureStorage->textureBuffers.Contains(name)) return false;
+	// Teams and distances change, textures which became relevant are offered late
+	const double now = FPlatformTime::Seconds();
+	if (now < nextRelevancyUpdate) return;
+	nextRelevancyUpdate = now + GetDefault<UReplicatedTextureSettings>()->relevancyUpdateInterval;
 
-	TArray<uint8>* savedBuffer = textureStorage->textureBuffers.Find(name);
+	for (const TPair<FString, FTextureRelevancy>& pair : textureStorage->relevancy)
+	{
+		const FString& name = pair.Key;
+		if (announcedTextures.Contains(name) || !textureStorage->IsLoaded(name) || !pair.Value.IsRelevant(player)) continue;
 
-	return savedBuffer->IsValidIndex(begin);
-}
+		offerTexture(name);
 
-void UReplicatedTextureComponent::askChunkServer_Implementation(const FString& name, uint64 begin)
-{
-	TArray<uint8> chunk;
-	uint64 left = getChunk(name, begin, chunk);
-	replicateChunkOwner(chunk, left <= 0, name);
-	//UE_LOG(LogReplicaetdTexture, Warning, TEXT("Sending chunk with size %04d"), chunk.Num());
+		for (const FString& patchName : textureStorage->patches)
+		{
+			const FTextureTransferHeader* patchHeader = textureStorage->textureHeaders.Find(patchName);
+			if (patchHeader != nullptr && patchHeader->patchTarget == name)
+			{
+				offerTexture(patchName);
+			}
+		}
+	}
 }
 
-uint64 UReplicatedTextureComponent::getChunk(const FString& name, uint64 begin, TArray<uint8>& chunk) const
+bool UReplicatedTextureComponent::deferDownload(const FString& name, const FTextureTransferHeader& header)
 {
-	TArray<uint8>* savedBuffer = textureStorage->textureBuffers.Find(name);
+	if (!header.bOnDemand) return false;
 
-	savedBuffer = textureStorage->textureBuffers.Find(name);
+	// Patch of a texture which is already here is downloaded right away
+	if (!header.patchTarget.IsEmpty() && !textureStorage->onDemand.Contains(header.patchTarget)) return false;
 
-	uint64 left = savedBuffer->Num() - begin;
-	uint64 chunkSize = FMath::Min(left, maxChunkSize);
-	
-	chunk.AddUninitialized(chunkSize);
-	FMemory::Memcpy(chunk.GetData(), savedBuffer->GetData() + begin, chunkSize);
+	textureStorage->onDemand.Add(name);
 
-	return savedBuffer->Num() - (chunkSize + begin);
+	if (namedQueue.IsEmpty() && pendingDecodes == 0)
+	{
+		notifyQueueEmtpy();
+	}
+	return true;
 }
 
-void UReplicatedTextureComponent::recieveChunk(const TArray<uint8>& chunk, bool end, const FString& textureName)
+void UReplicatedTextureComponent::downloadTextures()
 {
-	TArray<uint8>* recv = textureStorage->textureBuffers.Find(textureName);
-
-	recv->Append(chunk.GetData(), chunk.Num());
+	if (textureStorage->downloadRequests.IsEmpty()) return;
 
-	//UE_LOG(LogReplicaetdTexture, Warning, TEXT("Recieving chunk with size %d, (%d loaded)"), chunk.Num(), recv->Num());
+	TSet<FString> requests = MoveTemp(textureStorage->downloadRequests);
+	textureStorage->downloadRequests.Reset();
 
-	chunkReady = true;
-
-	if (end)
+	for (const FString& name : requests)
 	{
+		if (!textureStorage->onDemand.Remove(name)) continue;
 
-		isDownloading = false;
-		namedQueue.RemoveSingleSwap(textureName);
-
-		// Decompress texture nad validate
-		// Remove from buffers, if it's invalid
-		AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [textureName, this] {
+		const FTextureTransferHeader* header = textureStorage->textureHeaders.Find(name);
+		if (header == nullptr) continue;
 
-			TArray<uint8>* buff = textureStorage->textureBuffers.Find(textureName);
+		UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture \"%s\" is asked for, downloading it"), *name);
 
-			UTexture2D* texture = FImageUtils::ImportBufferAsTexture2D(*buff);
+		if (!loadFromDiskCache(name, *header))
+		{
+			enqueue(name);
+		}
 
-			AsyncTask(ENamedThreads::GameThread, [textureName, texture, this, buff] {
-				if (IsValid(texture))
-				{
-					postReplicateTexture(texture, textureName);
-					UE_LOG(LogReplicaetdTexture, Log, TEXT("Texture is ready, total compressed size is %d"), buff->Num());
-				}
-				else
-				{
-					UE_LOG(LogReplicaetdTexture, Error, TEXT("Couldn't decompress a texture for some reason"));
-					textureStorage->textureBuffers.Remove(textureName);
-				}
+		// Patches wait for their texture anyway
+		for (TSet<FString>::TIterator it = textureStorage->onDemand.CreateIterator(); it; ++it)
+		{
+			const FTextureTransferHeader* patchHeader = textureStorage->textureHeaders.Find(*it);
+			if (patchHeader == nullptr || patchHeader->patchTarget != name) continue;
 
-			});
-		});
+			enqueue(*it);
+			it.RemoveCurrent();
+		}
 	}
 }
 
-void UReplicatedTextureComponent::replicateTextureToAll(const FString& name)
+TArray<UReplicatedTextureComponent*> UReplicatedTextureComponent::getPlayerComponents() const
 {
 	TArray<AActor*> players;
 	UGameplayStatics::GetAllActorsOfClass(GetWorld(), APlayerController::StaticClass(), players);
 
+	TArray<UReplicatedTextureComponent*> components;
 	for (const AActor* pca : players)
 	{
 		const APlayerController* player = Cast<APlayerController>(pca);
@@ -445,11 +2593,11 @@ void UReplicatedTextureComponent::replicateTextureToAll(const FString& name)
 
 		if (IsValid(repl))
 		{
-			repl->bClientJobDone = false;
-			repl->bAllJobsDone = false;
-			repl->replicateTextureOwner(name);
+			components.Add(repl);
 		}
 	}
+
+	return components;
 }
 
 void UReplicatedTextureComponent::SetPauseReplication_Implementation(bool pause)
@@ -473,9 +2621,45 @@ const UTexture2D* UReplicatedTextureComponent:: FindTexture(const FString& name)
 	const TObjectPtr<UTexture2D>* texture = textureStorage->replicatedTextures.Find(name);
 
 	if (texture == nullptr)
+	{
+		// Evicted or on demand texture comes through OnTextureReady
+		textureStorage->RequestReload(name);
+		textureStorage->RequestDownload(name);
 		return nullptr;
-	else
-		return texture->Get();
+	}
+
+	textureStorage->Touch(name);
+	return texture->Get();
+}
+
+void UReplicatedTextureComponent::SetTextureRelevancy(const FString& name, const FTextureRelevancy& relevancy)
+{
+	if (!IsValid(textureStorage) || GetNetMode() == NM_Client) return;
+
+	// Players it became relevant for get it on the next update
+	textureStorage->relevancy.Add(name, relevancy);
+}
+
+void UReplicatedTextureComponent::RequestTexture(const FString& name)
+{
+	if (!IsValid(textureStorage)) return;
+
+	textureStorage->RequestDownload(name);
+}
+
+bool UReplicatedTextureComponent::FindAtlasSlot(const FString& name, FReplicatedTextureAtlasSlot& slot) const
+{
+	if (!IsValid(textureStorage)) return false;
+
+	if (!textureStorage->atlas.FindSlot(name, slot))
+	{
+		textureStorage->RequestReload(name);
+		textureStorage->RequestDownload(name);
+		return false;
+	}
+
+	textureStorage->Touch(name);
+	return true;
 }
 
 void UReplicatedTextureComponent::RepNotifyAllJobDone()
@@ -493,6 +2677,9 @@ void UReplicatedTextureComponent::queueEmtpyServer_Implementation()
 	bClientJobDone = true;
 	bAllJobsDone = namedQueue.IsEmpty();
 	RepNotifyAllJobDone();
+
+	// Client has everything it asked for
+	releaseServedTextures(0.0);
 }
 
 void UReplicatedTextureComponent::notifyQueueEmtpy()
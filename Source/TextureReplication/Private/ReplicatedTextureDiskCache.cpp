@@ -0,0 +1,204 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureDiskCache.h"
+#include "ReplicatedTextureComponent.h"
+#include "ReplicatedTextureSettings.h"
+#include "Async/Async.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Hash/xxhash.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+FMappedTextureBuffer::~FMappedTextureBuffer()
+{
+	delete region;
+	delete handle;
+}
+
+TArrayView64<const uint8> FMappedTextureBuffer::GetView() const
+{
+	return TArrayView64<const uint8>(region->GetMappedPtr(), region->GetMappedSize());
+}
+
+FReplicatedTextureDiskCache& FReplicatedTextureDiskCache::Get()
+{
+	static FReplicatedTextureDiskCache cache;
+	return cache;
+}
+
+FReplicatedTextureDiskCache::FReplicatedTextureDiskCache()
+{
+	directory = FPaths::ProjectSavedDir() / TEXT("ReplicatedTextures");
+}
+
+bool FReplicatedTextureDiskCache::IsEnabled() const
+{
+	return GetDefault<UReplicatedTextureSettings>()->bUseDiskCache;
+}
+
+FString FReplicatedTextureDiskCache::getPath(uint64 hash) const
+{
+	return directory / FString::Printf(TEXT("%016llx.rtc"), hash);
+}
+
+FString FReplicatedTextureDiskCache::getPartialPath(uint64 hash) const
+{
+	return directory / FString::Printf(TEXT("%016llx.part"), hash);
+}
+
+TSharedPtr<FMappedTextureBuffer, ESPMode::ThreadSafe> FReplicatedTextureDiskCache::Load(uint64 hash) const
+{
+	if (!IsEnabled()) return nullptr;
+
+	const FString path = getPath(hash);
+
+	IMappedFileHandle* handle = FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*path);
+	if (handle == nullptr) return nullptr;
+
+	TSharedPtr<FMappedTextureBuffer, ESPMode::ThreadSafe> mapped = MakeShared<FMappedTextureBuffer, ESPMode::ThreadSafe>();
+	mapped->handle = handle;
+	mapped->region = handle->MapRegion(0, handle->GetFileSize());
+
+	if (mapped->region == nullptr) return nullptr;
+
+	// Timestamp is what the trimming sorts by
+	IFileManager::Get().SetTimeStamp(*path, FDateTime::UtcNow());
+
+	return mapped;
+}
+
+void FReplicatedTextureDiskCache::Save(uint64 hash, const FTextureBufferRef& buffer)
+{
+	if (!IsEnabled()) return;
+
+	const FString path = getPath(hash);
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [this, path, buffer] {
+		// Written under another name first, so a half written file is never mapped
+		const FString tempPath = path + TEXT(".tmp");
+
+		if (FFileHelper::SaveArrayToFile(*buffer, *tempPath) && IFileManager::Get().Move(*path, *tempPath))
+		{
+			trim();
+		}
+		else
+		{
+			UE_LOG(LogReplicaetdTexture, Warning, TEXT("Couldn't write texture cache file %s"), *path);
+			IFileManager::Get().Delete(*tempPath);
+		}
+	});
+}
+
+void FReplicatedTextureDiskCache::Remove(uint64 hash)
+{
+	IFileManager::Get().Delete(*getPath(hash));
+}
+
+void FReplicatedTextureDiskCache::SavePartial(uint64 hash, TArray64<uint8>&& prefix)
+{
+	if (!IsEnabled() || prefix.IsEmpty()) return;
+
+	const FString path = getPartialPath(hash);
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [this, path, prefix = MoveTemp(prefix)] {
+		const FString tempPath = path + TEXT(".tmp");
+
+		// Hash of the prefix goes first, the file may be cut or damaged until the next session
+		uint64 prefixHash = FXxHash64::HashBuffer(prefix.GetData(), prefix.Num()).Hash;
+
+		bool bWritten = false;
+		if (TUniquePtr<FArchive> writer = TUniquePtr<FArchive>(IFileManager::Get().CreateFileWriter(*tempPath)))
+		{
+			*writer << prefixHash;
+			writer->Serialize(const_cast<uint8*>(prefix.GetData()), prefix.Num());
+			bWritten = writer->Close();
+		}
+
+		if (bWritten && IFileManager::Get().Move(*path, *tempPath))
+		{
+			trim();
+		}
+		else
+		{
+			UE_LOG(LogReplicaetdTexture, Warning, TEXT("Couldn't write partial texture file %s"), *path);
+			IFileManager::Get().Delete(*tempPath);
+		}
+	});
+}
+
+int64 FReplicatedTextureDiskCache::LoadPartial(uint64 hash, TArrayView64<uint8> buffer)
+{
+	if (!IsEnabled()) return 0;
+
+	const FString path = getPartialPath(hash);
+
+	int64 size = 0;
+	if (TUniquePtr<FArchive> reader = TUniquePtr<FArchive>(IFileManager::Get().CreateFileReader(*path)))
+	{
+		uint64 prefixHash = 0;
+		size = reader->TotalSize() - (int64)sizeof(prefixHash);
+
+		// Full buffer would have been cached instead
+		if (size > 0 && size < buffer.Num())
+		{
+			*reader << prefixHash;
+			reader->Serialize(buffer.GetData(), size);
+
+			if (reader->IsError() || FXxHash64::HashBuffer(buffer.GetData(), size).Hash != prefixHash)
+			{
+				UE_LOG(LogReplicaetdTexture, Warning, TEXT("Partial texture file %s is damaged, skipping"), *path);
+				size = 0;
+			}
+		}
+		else
+		{
+			size = 0;
+		}
+	}
+
+	IFileManager::Get().Delete(*path);
+	return size;
+}
+
+void FReplicatedTextureDiskCache::trim()
+{
+	FScopeLock scopeLock(&trimLock);
+
+	struct FCachedFile
+	{
+		FString path;
+		FDateTime time;
+		int64 size;
+	};
+
+	TArray<FCachedFile> files;
+	int64 totalSize = 0;
+
+	IFileManager::Get().IterateDirectoryStat(*directory, [&files, &totalSize](const TCHAR* path, const FFileStatData& stat) {
+		const FString extension = FPaths::GetExtension(path);
+		if (!stat.bIsDirectory && (extension == TEXT("rtc") || extension == TEXT("part")))
+		{
+			files.Add({ path, stat.ModificationTime, stat.FileSize });
+			totalSize += stat.FileSize;
+		}
+		return true;
+	});
+
+	const int64 maxSize = (int64)GetDefault<UReplicatedTextureSettings>()->diskCacheSizeMB * 1024 * 1024;
+	if (totalSize <= maxSize) return;
+
+	files.Sort([](const FCachedFile& a, const FCachedFile& b) { return a.time < b.time; });
+
+	for (const FCachedFile& file : files)
+	{
+		if (totalSize <= maxSize) break;
+
+		if (IFileManager::Get().Delete(*file.path))
+		{
+			totalSize -= file.size;
+		}
+	}
+}
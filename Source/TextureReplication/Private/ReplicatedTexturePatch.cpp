@@ -0,0 +1,294 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTexturePatch.h"
+#include "ReplicatedTextureBlockCompression.h"
+#include "ReplicatedTextureComponent.h"
+#include "ImageCore.h"
+#include "Engine/Texture2D.h"
+#include "Hash/xxhash.h"
+#include "Misc/Compression.h"
+#include "RenderingThread.h"
+#include "TextureResource.h"
+
+namespace
+{
+	const int32 bytesPerPixel = 4;
+
+	int32 GetTilesX(int32 width)
+	{
+		return FMath::DivideAndRoundUp(width, FTexturePatches::tileSize);
+	}
+
+	int32 GetNumTiles(int32 width, int32 height)
+	{
+		return GetTilesX(width) * FMath::DivideAndRoundUp(height, FTexturePatches::tileSize);
+	}
+
+	// Edge tiles are smaller than tileSize
+	FIntRect GetTileRect(int32 index, int32 width, int32 height)
+	{
+		const int32 x = index % GetTilesX(width) * FTexturePatches::tileSize;
+		const int32 y = index / GetTilesX(width) * FTexturePatches::tileSize;
+		return FIntRect(x, y, FMath::Min(x + FTexturePatches::tileSize, width), FMath::Min(y + FTexturePatches::tileSize, height));
+	}
+
+	uint64 HashTile(const uint8* pixels, int64 pitch, int32 width, int32 height)
+	{
+		FXxHash64Builder builder;
+		for (int32 row = 0; row < height; row++)
+		{
+			builder.Update(pixels + row * pitch, width * bytesPerPixel);
+		}
+		return builder.Finalize().Hash;
+	}
+
+	// Offset of the tile in the decoded column
+	int64 GetColumnOffset(int32 position)
+	{
+		return (int64)position * FTexturePatches::tileSize * FTexturePatches::tileSize * bytesPerPixel;
+	}
+}
+
+FString FTexturePatches::GetPatchName(const FString& name, int32 version)
+{
+	return FString::Printf(TEXT("%s%c%d"), *name, separator, version);
+}
+
+void FTexturePatches::HashTiles(const uint8* pixels, int32 width, int32 height, TArray<uint64>& hashes)
+{
+	const int64 pitch = (int64)width * bytesPerPixel;
+	hashes.SetNum(GetNumTiles(width, height));
+
+	for (int32 i = 0; i < hashes.Num(); i++)
+	{
+		const FIntRect rect = GetTileRect(i, width, height);
+		hashes[i] = HashTile(pixels + rect.Min.Y * pitch + rect.Min.X * bytesPerPixel, pitch, rect.Width(), rect.Height());
+	}
+}
+
+bool FTexturePatches::Encode(const FImage& image, const TArray<uint64>& oldHashes, TArray<uint64>& newHashes, FTextureTransferHeader& header, TArray64<uint8>& buffer)
+{
+	check(image.Format == ERawImageFormat::BGRA8);
+
+	HashTiles(image.RawData.GetData(), image.SizeX, image.SizeY, newHashes);
+	if (newHashes.Num() != oldHashes.Num()) return false;
+
+	// Index of each changed tile followed by its rows
+	const int64 pitch = (int64)image.SizeX * bytesPerPixel;
+	TArray64<uint8> raw;
+	for (int32 i = 0; i < newHashes.Num(); i++)
+	{
+		if (newHashes[i] == oldHashes[i]) continue;
+
+		const FIntRect rect = GetTileRect(i, image.SizeX, image.SizeY);
+		raw.Append((const uint8*)&i, sizeof(int32));
+		for (int32 row = rect.Min.Y; row < rect.Max.Y; row++)
+		{
+			raw.Append(image.RawData.GetData() + row * pitch + rect.Min.X * bytesPerPixel, rect.Width() * bytesPerPixel);
+		}
+	}
+
+	if (raw.IsEmpty() || raw.Num() > MAX_int32) return false;
+
+	int32 compressedSize = FCompression::CompressMemoryBound(NAME_LZ4, raw.Num());
+	buffer.SetNumUninitialized(compressedSize);
+
+	if (!FCompression::CompressMemory(NAME_LZ4, buffer.GetData(), compressedSize, raw.GetData(), raw.Num()))
+		return false;
+
+	buffer.SetNum(compressedSize);
+
+	header.codec = ETextureCodec::LZ4;
+	header.width = image.SizeX;
+	header.height = image.SizeY;
+	header.format = ERawImageFormat::BGRA8;
+	header.bSRGB = image.IsGammaCorrected();
+	header.rawSize = raw.Num();
+	return true;
+}
+
+bool FTexturePatches::Validate(const FTextureTransferHeader& header)
+{
+	// Every tile at most once
+	const int64 maxRawSize = (int64)header.width * header.height * bytesPerPixel
+		+ (int64)GetNumTiles(header.width, header.height) * sizeof(int32);
+
+	return header.codec == ETextureCodec::LZ4 && header.format == ERawImageFormat::BGRA8
+		&& header.rawSize > 0 && header.rawSize <= maxRawSize && header.rawSize <= MAX_int32;
+}
+
+bool FTexturePatches::Decode(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedPatch& patch)
+{
+	if (!Validate(header)) return false;
+
+	const int32 numTiles = GetNumTiles(header.width, header.height);
+
+	TArray64<uint8> raw;
+	raw.SetNumUninitialized(header.rawSize);
+
+	if (!FCompression::UncompressMemory(NAME_LZ4, raw.GetData(), header.rawSize, buffer.GetData(), buffer.Num()))
+		return false;
+
+	patch.version = header.version;
+	patch.baseVersion = header.baseVersion;
+	patch.width = header.width;
+	patch.height = header.height;
+
+	int64 offset = 0;
+	while (offset < raw.Num())
+	{
+		int32 index = 0;
+		if (offset + (int64)sizeof(int32) > raw.Num()) return false;
+		FMemory::Memcpy(&index, raw.GetData() + offset, sizeof(int32));
+		offset += sizeof(int32);
+
+		if (index < 0 || index >= numTiles) return false;
+
+		const FIntRect rect = GetTileRect(index, header.width, header.height);
+		const int64 rowSize = (int64)rect.Width() * bytesPerPixel;
+		if (offset + rowSize * rect.Height() > raw.Num()) return false;
+
+		const int64 columnOffset = GetColumnOffset(patch.tiles.Num());
+		patch.pixels.AddUninitialized(GetColumnOffset(1));
+		for (int32 row = 0; row < rect.Height(); row++)
+		{
+			FMemory::Memcpy(patch.pixels.GetData() + columnOffset + row * tileSize * bytesPerPixel, raw.GetData() + offset, rowSize);
+			offset += rowSize;
+		}
+
+		patch.tiles.Add(index);
+	}
+
+	return !patch.tiles.IsEmpty();
+}
+
+bool FTexturePatches::Apply(UTexture2D* texture, const FDecodedPatch& patch)
+{
+	if (!IsValid(texture)) return false;
+
+	return Apply(texture, patch, FIntRect(0, 0, texture->GetSizeX(), texture->GetSizeY()));
+}
+
+bool FTexturePatches::Apply(UTexture2D* texture, const FDecodedPatch& patch, const FIntRect& target)
+{
+	if (IsValid(texture) && FTextureBlockCompression::IsBlockFormat(texture->GetPixelFormat()))
+	{
+		return applyBlocks(texture, patch);
+	}
+
+	if (!IsValid(texture) || texture->GetPixelFormat() != PF_B8G8R8A8
+		|| target.Width() != patch.width || target.Height() != patch.height
+		|| target.Max.X > texture->GetSizeX() || target.Max.Y > texture->GetSizeY())
+	{
+		return false;
+	}
+
+	const int32 numRegions = patch.tiles.Num();
+	FUpdateTextureRegion2D* regions = new FUpdateTextureRegion2D[numRegions];
+	for (int32 i = 0; i < numRegions; i++)
+	{
+		const FIntRect rect = GetTileRect(patch.tiles[i], patch.width, patch.height);
+		regions[i] = FUpdateTextureRegion2D(target.Min.X + rect.Min.X, target.Min.Y + rect.Min.Y, 0, i * tileSize, rect.Width(), rect.Height());
+	}
+
+	// Render thread reads them later, freed by the cleanup callback
+	uint8* pixels = (uint8*)FMemory::Malloc(patch.pixels.Num());
+	FMemory::Memcpy(pixels, patch.pixels.GetData(), patch.pixels.Num());
+
+	texture->UpdateTextureRegions(0, numRegions, regions, tileSize * bytesPerPixel, bytesPerPixel, pixels,
+		[](uint8* data, const FUpdateTextureRegion2D* updatedRegions) {
+			FMemory::Free(data);
+			delete[] updatedRegions;
+		});
+
+	return true;
+}
+
+bool FTexturePatches::applyBlocks(UTexture2D* texture, const FDecodedPatch& patch)
+{
+	const EPixelFormat format = texture->GetPixelFormat();
+	const int32 blockSize = FTextureBlockCompression::blockSize;
+	const int32 blockBytes = FTextureBlockCompression::GetBlockBytes(format);
+
+	// Compressed textures are made of whole blocks, so are their tiles
+	if (patch.width != texture->GetSizeX() || patch.height != texture->GetSizeY()
+		|| patch.width % blockSize != 0 || patch.height % blockSize != 0)
+	{
+		return false;
+	}
+
+	// Alpha is dropped if the texture was opaque, it is reloaded with the right format when evicted
+	TArray64<uint8> blocks;
+	FTextureBlockCompression::CompressPixels(patch.pixels.GetData(), tileSize, tileSize * patch.tiles.Num(), tileSize * bytesPerPixel, format, blocks);
+
+	// Source offsets are in blocks
+	const int32 numRegions = patch.tiles.Num();
+	FUpdateTextureRegion2D* regions = new FUpdateTextureRegion2D[numRegions];
+	for (int32 i = 0; i < numRegions; i++)
+	{
+		const FIntRect rect = GetTileRect(patch.tiles[i], patch.width, patch.height);
+		regions[i] = FUpdateTextureRegion2D(rect.Min.X, rect.Min.Y, 0, i * tileSize / blockSize, rect.Width(), rect.Height());
+	}
+
+	uint8* data = (uint8*)FMemory::Malloc(blocks.Num());
+	FMemory::Memcpy(data, blocks.GetData(), blocks.Num());
+
+	texture->UpdateTextureRegions(0, numRegions, regions, tileSize / blockSize * blockBytes, blockBytes, data,
+		[](uint8* data, const FUpdateTextureRegion2D* updatedRegions) {
+			FMemory::Free(data);
+			delete[] updatedRegions;
+		});
+
+	return true;
+}
+
+bool FTexturePatches::ApplyToPixels(const FDecodedPatch& patch, TArray64<uint8>& pixels)
+{
+	const int64 pitch = (int64)patch.width * bytesPerPixel;
+	if (pixels.Num() != pitch * patch.height) return false;
+
+	for (int32 i = 0; i < patch.tiles.Num(); i++)
+	{
+		const FIntRect rect = GetTileRect(patch.tiles[i], patch.width, patch.height);
+		for (int32 row = 0; row < rect.Height(); row++)
+		{
+			FMemory::Memcpy(pixels.GetData() + (rect.Min.Y + row) * pitch + rect.Min.X * bytesPerPixel
+				, patch.pixels.GetData() + GetColumnOffset(i) + row * tileSize * bytesPerPixel, rect.Width() * bytesPerPixel);
+		}
+	}
+
+	return true;
+}
+
+void FTexturePatches::UpdateHashes(const FDecodedPatch& patch, TArray<uint64>& hashes)
+{
+	for (int32 i = 0; i < patch.tiles.Num(); i++)
+	{
+		if (!hashes.IsValidIndex(patch.tiles[i])) continue;
+
+		const FIntRect rect = GetTileRect(patch.tiles[i], patch.width, patch.height);
+		hashes[patch.tiles[i]] = HashTile(patch.pixels.GetData() + GetColumnOffset(i), tileSize * bytesPerPixel, rect.Width(), rect.Height());
+	}
+}
+
+UTexture2D* FTexturePatches::CopyTexture(UTexture2D* texture)
+{
+	UTexture2D* copy = UTexture2D::CreateTransient(texture->GetSizeX(), texture->GetSizeY(), texture->GetPixelFormat());
+	if (!IsValid(copy)) return nullptr;
+
+	copy->SRGB = texture->SRGB;
+	copy->UpdateResource();
+
+	// Resources are created by commands enqueued before this one
+	FTextureResource* source = texture->GetResource();
+	FTextureResource* destination = copy->GetResource();
+	ENQUEUE_RENDER_COMMAND(CopyReplicatedTexture)([source, destination](FRHICommandListImmediate& RHICmdList) {
+		if (source != nullptr && destination != nullptr && source->TextureRHI.IsValid() && destination->TextureRHI.IsValid())
+		{
+			RHICmdList.CopyTexture(source->TextureRHI, destination->TextureRHI, FRHICopyTextureInfo());
+		}
+	});
+
+	return copy;
+}
@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureRelevancy.h"
+#include "GenericTeamAgentInterface.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+
+bool FTextureRelevancy::IsRelevant(const APlayerController* player) const
+{
+	if (!IsValid(player)) return false;
+
+	if (!recipients.IsEmpty() && !recipients.ContainsByPredicate([player](const TObjectPtr<APlayerController>& recipient) {
+		return recipient.Get() == player;
+	}))
+	{
+		return false;
+	}
+
+	if (team != FGenericTeamId::NoTeam.GetId())
+	{
+		FGenericTeamId playerTeam = FGenericTeamId::GetTeamIdentifier(player);
+		if (playerTeam == FGenericTeamId::NoTeam && player->GetPawn() != nullptr)
+		{
+			playerTeam = FGenericTeamId::GetTeamIdentifier(player->GetPawn());
+		}
+
+		if (playerTeam.GetId() != team) return false;
+	}
+
+	if (maxDistance > 0 && IsValid(owner))
+	{
+		// Spectators have no pawn, their camera is used instead
+		FVector location;
+		if (player->GetPawn() != nullptr)
+		{
+			location = player->GetPawn()->GetActorLocation();
+		}
+		else
+		{
+			FRotator rotation;
+			player->GetPlayerViewPoint(location, rotation);
+		}
+
+		if (FVector::DistSquared(location, owner->GetActorLocation()) > FMath::Square(maxDistance)) return false;
+	}
+
+	return true;
+}
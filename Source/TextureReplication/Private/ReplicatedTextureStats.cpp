@@ -0,0 +1,18 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureStats.h"
+
+DEFINE_STAT(STAT_TextureReplication_Compress);
+DEFINE_STAT(STAT_TextureReplication_Decode);
+DEFINE_STAT(STAT_TextureReplication_BlockCompress);
+
+DEFINE_STAT(STAT_TextureReplication_Queued);
+DEFINE_STAT(STAT_TextureReplication_ActiveTransfers);
+DEFINE_STAT(STAT_TextureReplication_PendingDecodes);
+DEFINE_STAT(STAT_TextureReplication_BytesSent);
+DEFINE_STAT(STAT_TextureReplication_BytesRecieved);
+DEFINE_STAT(STAT_TextureReplication_ChunkRetries);
+DEFINE_STAT(STAT_TextureReplication_TransferRetries);
+
+CSV_DEFINE_CATEGORY_MODULE(TEXTUREREPLICATION_API, TextureReplication, true);
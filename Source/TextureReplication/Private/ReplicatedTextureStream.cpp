@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureStream.h"
+#include "ReplicatedTextureComponent.h"
+#include "ReplicatedTextureSettings.h"
+#include "ReplicatedTexturesStorage.h"
+#include "Algo/BinarySearch.h"
+#include "Engine/NetDriver.h"
+#include "Kismet/GameplayStatics.h"
+#include "Net/UnrealNetwork.h"
+
+// Recieved parts of a chunk are kept as bits of one byte
+static_assert(AReplicatedTextureStream::partsPerChunk <= 8 && UReplicatedTextureComponent::maxChunkSize % AReplicatedTextureStream::partsPerChunk == 0
+	, "Stream parts must split a chunk evenly");
+
+void FReplicatedTextureStreamItem::PostReplicatedAdd(const FReplicatedTextureStreamItems& items)
+{
+	if (items.owner != nullptr)
+	{
+		items.owner->RecieveItem(*this);
+	}
+}
+
+AReplicatedTextureStream::AReplicatedTextureStream()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	bReplicates = true;
+	bAlwaysRelevant = true;
+	SetReplicatingMovement(false);
+	NetUpdateFrequency = 30.f;
+
+	stream.owner = this;
+}
+
+void AReplicatedTextureStream::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(AReplicatedTextureStream, stream);
+}
+
+void AReplicatedTextureStream::Push(const FString& name)
+{
+	AReplicatedTexturesStorage* storage = UReplicatedTextureComponent::textureStorage;
+	if (!IsValid(storage) || IsStreaming(name)) return;
+
+	const FTextureTransferHeader* header = storage->textureHeaders.Find(name);
+	if (header == nullptr || !storage->textureBuffers.Contains(name)) return;
+
+	storage->Pin(name);
+
+	// After everything with the same or higher priority, like the download queue
+	const int32 priority = header->priority;
+	const int32 index = Algo::UpperBoundBy(pending, -priority, [](const FStreamedTexture& streamed) { return -streamed.priority; });
+	pending.Insert({ name, 0, priority }, index);
+}
+
+bool AReplicatedTextureStream::IsStreaming(const FString& name) const
+{
+	return pending.ContainsByPredicate([&name](const FStreamedTexture& streamed) { return streamed.name == name; });
+}
+
+void AReplicatedTextureStream::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	AReplicatedTexturesStorage* storage = UReplicatedTextureComponent::textureStorage;
+	if (!HasAuthority() || pending.IsEmpty() || !IsValid(storage)) return;
+
+	const UReplicatedTextureSettings* settings = GetDefault<UReplicatedTextureSettings>();
+	const double now = FPlatformTime::Seconds();
+
+	bandwidth.Refill(settings->streamKBPerSecond * 1024.0, now);
+	storage->bandwidth.Refill(settings->serverKBPerSecond * 1024.0, now);
+
+	// Parts pushed between net updates go out together, so no more than the stream keeps are pushed at once
+	if (now < nextPushTime) return;
+
+	// Replication sends each part to every client, like answering each of them would
+	const UNetDriver* driver = GetNetDriver();
+	const int32 connections = driver != nullptr ? driver->ClientConnections.Num() : 0;
+
+	int32 pushed = 0;
+	while (pushed < maxItems && !pending.IsEmpty() && bandwidth.CanSend() && storage->bandwidth.CanSend())
+	{
+		FStreamedTexture& streamed = pending[0];
+		const FTextureBufferRef* buffer = storage->textureBuffers.Find(streamed.name);
+
+		// Pushed whole, or forgotten meanwhile and clients are told so when they ask for it
+		if (buffer == nullptr || streamed.nextOffset >= (uint64)(*buffer)->Num())
+		{
+			storage->Unpin(streamed.name);
+			pending.RemoveAt(0);
+			continue;
+		}
+
+		FReplicatedTextureStreamItem& item = stream.items.AddDefaulted_GetRef();
+		item.name = streamed.name;
+		item.begin = streamed.nextOffset;
+		item.part.buffer = *buffer;
+		item.part.offset = streamed.nextOffset;
+		item.part.size = (int32)FMath::Min<uint64>(partSize, (*buffer)->Num() - streamed.nextOffset);
+		// Item is serialized for every client, its checksum is computed only here
+		item.part.checksum = FCrc::MemCrc32(item.part.GetData(), item.part.size);
+		stream.MarkItemDirty(item);
+
+		streamed.nextOffset += item.part.size;
+		bandwidth.Consume(item.part.size);
+		storage->bandwidth.Consume(item.part.size);
+		bytesSent += item.part.size * connections;
+		pushed++;
+
+		INC_DWORD_STAT_BY(STAT_TextureReplication_BytesSent, item.part.size);
+		CSV_CUSTOM_STAT(TextureReplication, BytesStreamed, item.part.size, ECsvCustomStatOp::Accumulate);
+	}
+
+	if (pushed == 0) return;
+
+	nextPushTime = now + 1.0 / FMath::Max(NetUpdateFrequency, 1.f);
+
+	// Clients which didn't get dropped parts in time pull their chunks instead
+	if (stream.items.Num() > maxItems)
+	{
+		stream.items.RemoveAt(0, stream.items.Num() - maxItems);
+		stream.MarkArrayDirty();
+	}
+}
+
+void AReplicatedTextureStream::RecieveItem(const FReplicatedTextureStreamItem& item)
+{
+	APlayerController* player = UGameplayStatics::GetPlayerController(this, 0);
+	if (player == nullptr) return;
+
+	UReplicatedTextureComponent* component = player->FindComponentByClass<UReplicatedTextureComponent>();
+	if (component != nullptr)
+	{
+		component->RecieveStreamPart(item.name, item.begin, item.part);
+	}
+}
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureTypes.h"
+#include "ReplicatedTextureComponent.h"
+
+bool FReplicatedTextureChunk::IsValid() const
+{
+	return FCrc::MemCrc32(GetData(), size) == checksum;
+}
+
+bool FReplicatedTextureChunk::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 packedSize = size;
+	Ar.SerializeIntPacked(packedSize);
+
+	if (Ar.IsLoading())
+	{
+		if (packedSize > UReplicatedTextureComponent::maxChunkSize)
+		{
+			UE_LOG(LogReplicaetdTexture, Error, TEXT("Recieved chunk with size bigger than max"));
+			Ar.SetError();
+			bOutSuccess = false;
+			return false;
+		}
+
+		TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe> data = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>();
+		data->SetNumUninitialized(packedSize);
+		Ar.Serialize(data->GetData(), packedSize);
+
+		buffer = data;
+		offset = 0;
+		size = packedSize;
+	}
+	else
+	{
+		// Archive takes writable memory and the stored buffer is shared, so it's passed through the stack
+		uint8 block[4096];
+		for (int32 written = 0; written < size; written += sizeof(block))
+		{
+			const int32 blockSize = FMath::Min<int32>(sizeof(block), size - written);
+			FMemory::Memcpy(block, GetData() + written, blockSize);
+			Ar.Serialize(block, blockSize);
+		}
+	}
+
+	// Sender computed it once for the chunk, it isn't hashed again for every connection
+	Ar << checksum;
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
@@ -3,6 +3,8 @@
 
 #include "ReplicatedTexturesStorage.h"
 #include "ReplicatedTextureComponent.h"
+#include "ReplicatedTextureSettings.h"
+#include "Engine/Texture2D.h"
 
 AReplicatedTexturesStorage::AReplicatedTexturesStorage()
 {
@@ -19,3 +21,240 @@ void AReplicatedTexturesStorage::BeginDestroy()
 }
 
 
+
+bool AReplicatedTexturesStorage::IsLoaded(const FString& name) const
+{
+	return replicatedTextures.Contains(name) || evictedTextures.Contains(name);
+}
+
+void AReplicatedTexturesStorage::Touch(const FString& name)
+{
+	lastUsed.Add(name, FPlatformTime::Seconds());
+	bEvictionOrderDirty = true;
+}
+
+void AReplicatedTexturesStorage::Pin(const FString& name)
+{
+	pins.FindOrAdd(name)++;
+}
+
+void AReplicatedTexturesStorage::Unpin(const FString& name)
+{
+	int32* count = pins.Find(name);
+	if (count != nullptr && --(*count) <= 0)
+	{
+		pins.Remove(name);
+	}
+}
+
+void AReplicatedTexturesStorage::RequestReload(const FString& name)
+{
+	if (evictedTextures.Contains(name) && !reloading.Contains(name))
+	{
+		reloadRequests.Add(name);
+	}
+}
+
+void AReplicatedTexturesStorage::RequestDownload(const FString& name)
+{
+	if (onDemand.Contains(name))
+	{
+		downloadRequests.Add(name);
+	}
+}
+
+uint32 AReplicatedTexturesStorage::GetChunkChecksum(const FString& name, const FTextureBufferRef& buffer, uint64 begin, int32 size)
+{
+	const uint64 chunkSize = UReplicatedTextureComponent::maxChunkSize;
+
+	// Downloads ask only at multiples of the chunk size
+	if (begin % chunkSize != 0) return FCrc::MemCrc32(buffer->GetData() + begin, size);
+
+	FChunkChecksums& checksums = chunkChecksums.FindOrAdd(name);
+	if (!checksums.buffer.HasSameObject(&buffer.Get()))
+	{
+		checksums.buffer = buffer;
+		checksums.values.Reset();
+		checksums.values.SetNum(FMath::DivideAndRoundUp<int64>(buffer->Num(), chunkSize));
+	}
+
+	TOptional<uint32>& checksum = checksums.values[begin / chunkSize];
+	if (!checksum.IsSet())
+	{
+		checksum = FCrc::MemCrc32(buffer->GetData() + begin, size);
+	}
+	return checksum.GetValue();
+}
+
+void AReplicatedTexturesStorage::Trim()
+{
+	const UReplicatedTextureSettings* settings = GetDefault<UReplicatedTextureSettings>();
+	const int64 megabyte = 1024 * 1024;
+
+	int64 maxTexturesSize = settings->maxTexturesMB > 0 ? settings->maxTexturesMB * megabyte : MAX_int64;
+	int64 maxBuffersSize = settings->maxBuffersMB > 0 ? settings->maxBuffersMB * megabyte : MAX_int64;
+
+	if (GetNetMode() == NM_DedicatedServer && settings->bDedicatedServerKeepsOnlyCompressed)
+	{
+		maxTexturesSize = 0;
+	}
+
+	// Atlas pages are shared, each of them is counted once
+	TSet<UTexture2D*> counted;
+	int64 texturesSize = 0;
+	for (const TPair<FString, TObjectPtr<UTexture2D>>& pair : replicatedTextures)
+	{
+		bool bCounted = false;
+		counted.Add(pair.Value, &bCounted);
+		texturesSize += IsValid(pair.Value) && !bCounted ? pair.Value->CalcTextureMemorySizeEnum(TMC_AllMips) : 0;
+	}
+
+	int64 buffersSize = 0;
+	for (const TPair<FString, FTextureBufferRef>& pair : textureBuffers)
+	{
+		buffersSize += pair.Value->Num();
+	}
+
+	if (texturesSize <= maxTexturesSize && buffersSize <= maxBuffersSize) return;
+
+	if (bEvictionOrderDirty || evictionOrder.Num() != loadedTexturesNames.Num())
+	{
+		evictionOrder = loadedTexturesNames;
+		evictionOrder.Sort([this](const FString& a, const FString& b) { return lastUsed.FindRef(a) < lastUsed.FindRef(b); });
+		bEvictionOrderDirty = false;
+	}
+
+	// Patches are only applied on top of their texture's buffer, so they go with it
+	TMap<FString, TArray<FString>> patchesByTarget;
+	for (const FString& patchName : patches)
+	{
+		const FTextureTransferHeader* patchHeader = textureHeaders.Find(patchName);
+		if (patchHeader != nullptr && textureBuffers.Contains(patchName))
+		{
+			patchesByTarget.FindOrAdd(patchHeader->patchTarget).Add(patchName);
+		}
+	}
+
+	// Server is the only source of buffers, so without its buffer the texture is gone
+	const bool bIsServer = GetNetMode() == NM_DedicatedServer || GetNetMode() == NM_ListenServer;
+
+	for (const FString& name : evictionOrder)
+	{
+		if (texturesSize <= maxTexturesSize && buffersSize <= maxBuffersSize) break;
+
+		// Bundle being sent needs all its textures
+		if (pins.Contains(name) || pins.Contains(bundledTextures.FindRef(name))) continue;
+
+		const TObjectPtr<UTexture2D>* texture = replicatedTextures.Find(name);
+		const FTextureBufferRef* buffer = textureBuffers.Find(name);
+
+		// Client without the buffer downloads it again
+		if (texturesSize > maxTexturesSize && texture != nullptr)
+		{
+			// Page is released only with its last texture
+			texturesSize -= atlas.Contains(name) ? atlas.Remove(name)
+				: IsValid(*texture) ? (*texture)->CalcTextureMemorySizeEnum(TMC_AllMips) : 0;
+			replicatedTextures.Remove(name);
+			evictedTextures.Add(name);
+		}
+
+		if (buffersSize > maxBuffersSize && buffer != nullptr)
+		{
+			buffersSize -= (*buffer)->Num();
+
+			// Reload needs the texture's buffer, its patches alone are of no use
+			for (const FString& patchName : patchesByTarget.FindRef(name))
+			{
+				if (pins.Contains(patchName)) continue;
+
+				buffersSize -= textureBuffers.FindChecked(patchName)->Num();
+				textureBuffers.Remove(patchName);
+				chunkChecksums.Remove(patchName);
+			}
+
+			if (bIsServer || !replicatedTextures.Contains(name))
+			{
+				UE_LOG(LogReplicaetdTexture, Log, TEXT("Forgetting texture \"%s\" to fit memory budget"), *name);
+				Forget(name);
+			}
+			else
+			{
+				textureBuffers.Remove(name);
+				chunkChecksums.Remove(name);
+			}
+		}
+	}
+}
+
+void AReplicatedTexturesStorage::Forget(const FString& name)
+{
+	const FTextureTransferHeader* header = textureHeaders.Find(name);
+	if (header != nullptr && namesByHash.FindRef(header->contentHash) == name)
+	{
+		namesByHash.Remove(header->contentHash);
+	}
+
+	for (TSet<FString>::TIterator it = patches.CreateIterator(); it; ++it)
+	{
+		const FTextureTransferHeader* patchHeader = textureHeaders.Find(*it);
+		if (patchHeader == nullptr || patchHeader->patchTarget != name) continue;
+
+		textureBuffers.Remove(*it);
+		textureHeaders.Remove(*it);
+		chunkChecksums.Remove(*it);
+		it.RemoveCurrent();
+	}
+
+	// Players joining later get the rest of the bundle one by one
+	FString bundle;
+	if (bundledTextures.RemoveAndCopyValue(name, bundle))
+	{
+		ForgetBundle(bundle);
+	}
+
+	atlas.Remove(name);
+	replicatedTextures.Remove(name);
+	progressTextures.Remove(name);
+	evictedTextures.Remove(name);
+	reloadRequests.Remove(name);
+	onDemand.Remove(name);
+	textureBuffers.Remove(name);
+	chunkChecksums.Remove(name);
+	textureHeaders.Remove(name);
+	textureVersions.Remove(name);
+	textureTiles.Remove(name);
+	pendingPatches.Remove(name);
+	lastUsed.Remove(name);
+	loadedTexturesNames.RemoveSingle(name);
+	bEvictionOrderDirty = true;
+}
+
+void AReplicatedTexturesStorage::AddBundle(const FString& name, const FTextureBundle& bundle)
+{
+	bundles.Add(name, bundle);
+
+	for (const FString& texture : bundle.names)
+	{
+		bundledTextures.FindOrAdd(texture, name);
+	}
+}
+
+void AReplicatedTexturesStorage::ForgetBundle(const FString& name)
+{
+	const FTextureBundle* bundle = bundles.Find(name);
+	if (bundle != nullptr)
+	{
+		for (const FString& texture : bundle->names)
+		{
+			if (bundledTextures.FindRef(texture) == name)
+			{
+				bundledTextures.Remove(texture);
+			}
+		}
+	}
+
+	bundles.Remove(name);
+	textureBuffers.Remove(name);
+	chunkChecksums.Remove(name);
+	textureHeaders.Remove(name);
+}
@@ -0,0 +1,201 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureBenchmark.h"
+#include "ReplicatedTextureComponent.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
+
+#include "Editor.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Settings/LevelEditorPlaySettings.h"
+#include "Tests/AutomationCommon.h"
+#include "Tests/AutomationEditorCommon.h"
+
+// Plays a new map as a listen server with clients in their own processes and runs the benchmark on it
+// Fails if the run times out, its throughput is below MinKBPerSecond, memory grew by more than MaxPeakMemoryMB
+// or game thread took longer than MaxGameThreadMs on average or MaxFrameMs in its worst frame
+//
+// Lag and loss go into PIE network emulation, which the editor applies to the server and passes to client processes
+// on their command line. Benchmark's own PktLag= and PktLoss= only change the server net driver, so they aren't used here,
+// run by hand clients need the same -PktLag= -PktLoss= to be delayed both ways
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FReplicatedTextureBenchmarkTest, "TextureReplication.Benchmark",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+namespace
+{
+	// Clients are separate processes, the editor needs a while to launch them
+	const double connectTimeout = 180.0;
+
+	UWorld* getServerWorld()
+	{
+		for (const FWorldContext& context : GEngine->GetWorldContexts())
+		{
+			UWorld* world = context.World();
+			if (context.WorldType == EWorldType::PIE && world != nullptr && world->GetNetMode() == NM_ListenServer)
+			{
+				return world;
+			}
+		}
+		return nullptr;
+	}
+
+	int32 getConnectedClients(UWorld* world)
+	{
+		const UNetDriver* driver = world->GetNetDriver();
+		if (driver == nullptr) return 0;
+
+		int32 connected = 0;
+		for (const UNetConnection* connection : driver->ClientConnections)
+		{
+			if (connection != nullptr && connection->PlayerController != nullptr)
+			{
+				connected++;
+			}
+		}
+		return connected;
+	}
+
+	// Test map has no game mode of the project, so players get their components here
+	// They are replicated, clients create them too
+	void addComponents(UWorld* world)
+	{
+		for (FConstPlayerControllerIterator it = world->GetPlayerControllerIterator(); it; ++it)
+		{
+			APlayerController* player = it->Get();
+			if (player == nullptr || player->FindComponentByClass<UReplicatedTextureComponent>() != nullptr) continue;
+
+			UReplicatedTextureComponent* component = NewObject<UReplicatedTextureComponent>(player);
+			player->AddInstanceComponent(component);
+			component->RegisterComponent();
+		}
+	}
+}
+
+void FReplicatedTextureBenchmarkTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	OutBeautifiedNames.Add(TEXT("Clean"));
+	OutTestCommands.Add(TEXT("Clients=2 Count=8 MinSize=64 MaxSize=1024 Timeout=120 MinKBPerSecond=64 MaxPeakMemoryMB=512 MaxGameThreadMs=50 MaxFrameMs=500 Lag=0 Loss=0"));
+
+	OutBeautifiedNames.Add(TEXT("Lossy"));
+	OutTestCommands.Add(TEXT("Clients=2 Count=8 MinSize=64 MaxSize=1024 Timeout=240 MinKBPerSecond=16 MaxPeakMemoryMB=512 MaxGameThreadMs=50 MaxFrameMs=500 Lag=100 Loss=2"));
+}
+
+bool FReplicatedTextureBenchmarkTest::RunTest(const FString& Parameters)
+{
+	int32 clients = 2;
+	int32 lag = 0;
+	int32 loss = 0;
+	float minKBPerSecond = 0.f;
+	float maxPeakMemoryMB = 0.f;
+	float maxGameThreadMs = 0.f;
+	float maxFrameMs = 0.f;
+	FParse::Value(*Parameters, TEXT("Clients="), clients);
+	FParse::Value(*Parameters, TEXT("Lag="), lag);
+	FParse::Value(*Parameters, TEXT("Loss="), loss);
+	FParse::Value(*Parameters, TEXT("MinKBPerSecond="), minKBPerSecond);
+	FParse::Value(*Parameters, TEXT("MaxPeakMemoryMB="), maxPeakMemoryMB);
+	FParse::Value(*Parameters, TEXT("MaxGameThreadMs="), maxGameThreadMs);
+	FParse::Value(*Parameters, TEXT("MaxFrameMs="), maxFrameMs);
+
+	FAutomationEditorCommonUtils::CreateNewMap();
+
+	ULevelEditorPlaySettings* settings = NewObject<ULevelEditorPlaySettings>();
+	settings->SetPlayNetMode(EPlayNetMode::PIE_ListenServer);
+	// Listen server's own player counts as one of them
+	settings->SetPlayNumberOfClients(clients + 1);
+	settings->SetRunUnderOneProcess(false);
+	settings->bLaunchSeparateServer = false;
+
+	settings->NetworkEmulationSettings.bIsNetworkEmulationEnabled = lag > 0 || loss > 0;
+	settings->NetworkEmulationSettings.EmulationTarget = NetworkEmulationTarget::Any;
+	settings->NetworkEmulationSettings.OutPackets.MinLatency = lag / 2;
+	settings->NetworkEmulationSettings.OutPackets.MaxLatency = lag;
+	settings->NetworkEmulationSettings.OutPackets.PacketLossPercentage = loss;
+	settings->NetworkEmulationSettings.InPackets = settings->NetworkEmulationSettings.OutPackets;
+
+	FRequestPlaySessionParams params;
+	params.EditorPlaySettings = settings;
+	params.WorldType = EPlaySessionWorldType::PlayInEditor;
+	GEditor->RequestPlaySession(params);
+
+	const double startTime = FPlatformTime::Seconds();
+	ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([this, clients, startTime] {
+		UWorld* world = getServerWorld();
+		if (world != nullptr && getConnectedClients(world) >= clients)
+		{
+			addComponents(world);
+			return true;
+		}
+
+		if (FPlatformTime::Seconds() - startTime > connectTimeout)
+		{
+			AddError(TEXT("Clients didn't connect in time"));
+			return true;
+		}
+		return false;
+	}));
+
+	// Replicated components have to reach clients before anything is offered to them
+	ADD_LATENT_AUTOMATION_COMMAND(FWaitLatentCommand(3.f));
+
+	TSharedRef<TSharedPtr<FReplicatedTextureBenchmarkResult>> result = MakeShared<TSharedPtr<FReplicatedTextureBenchmarkResult>>();
+	ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([this, Parameters, result] {
+		if (!HasAnyErrors())
+		{
+			*result = FReplicatedTextureBenchmark::Start(getServerWorld(), Parameters);
+			if (!result->IsValid())
+			{
+				AddError(TEXT("Benchmark couldn't start"));
+			}
+		}
+		return true;
+	}));
+
+	ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([this, result, minKBPerSecond, maxPeakMemoryMB, maxGameThreadMs, maxFrameMs] {
+		if (!result->IsValid()) return true;
+
+		const FReplicatedTextureBenchmarkResult& run = **result;
+		if (run.bRunning) return false;
+
+		TestFalse(TEXT("Benchmark timed out"), run.bTimedOut);
+		TestTrue(TEXT("Benchmark replicated textures"), run.numTextures > 0);
+
+		const double kbPerSecond = run.bytesPerSecond / 1024.0;
+		TestTrue(FString::Printf(TEXT("Throughput %.1f KB/s is at least %.1f KB/s"), kbPerSecond, minKBPerSecond), kbPerSecond >= minKBPerSecond);
+
+		// Zero leaves the limit out
+		const double peakMemoryMB = run.peakMemory / (1024.0 * 1024.0);
+		if (maxPeakMemoryMB > 0.f)
+		{
+			TestTrue(FString::Printf(TEXT("Peak memory %.1f MB is at most %.1f MB"), peakMemoryMB, maxPeakMemoryMB), peakMemoryMB <= maxPeakMemoryMB);
+		}
+		if (maxGameThreadMs > 0.f)
+		{
+			TestTrue(FString::Printf(TEXT("Average game thread %.2f ms is at most %.2f ms"), run.averageGameThreadMs, maxGameThreadMs)
+				, run.averageGameThreadMs <= maxGameThreadMs);
+		}
+		if (maxFrameMs > 0.f)
+		{
+			TestTrue(FString::Printf(TEXT("Slowest game thread frame %.2f ms is at most %.2f ms"), run.maxGameThreadMs, maxFrameMs)
+				, run.maxGameThreadMs <= maxFrameMs);
+		}
+
+		AddInfo(FString::Printf(TEXT("%d textures in %.2fs, %.1f KB/s, %.1f MB peak memory, %.2f ms game thread"), run.numTextures, run.seconds
+			, kbPerSecond, peakMemoryMB, run.averageGameThreadMs));
+		return true;
+	}));
+
+	ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([] {
+		GEditor->RequestEndPlayMap();
+		return true;
+	}));
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
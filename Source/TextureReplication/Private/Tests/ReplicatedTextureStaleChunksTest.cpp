@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ReplicatedTextureComponent.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+
+// Starts a download over by sending damaged chunks while the rest of its chunks are still in flight,
+// then lets those late chunks arrive, the way they do after a retry or cancel on a real connection
+// Late chunks must pass validation, which would disconnect the sender, and must not be written into the new download
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FReplicatedTextureStaleChunksTest, "TextureReplication.StaleChunks",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+namespace
+{
+	FReplicatedTextureChunk makeChunk(const FTextureBufferRef& buffer, uint64 begin, bool bDamaged)
+	{
+		FReplicatedTextureChunk chunk;
+		chunk.buffer = buffer;
+		chunk.offset = begin;
+		chunk.size = FMath::Min<uint64>(buffer->Num() - begin, UReplicatedTextureComponent::maxChunkSize);
+		chunk.checksum = FCrc::MemCrc32(chunk.GetData(), chunk.size) + (bDamaged ? 1 : 0);
+		return chunk;
+	}
+}
+
+bool FReplicatedTextureStaleChunksTest::RunTest(const FString& Parameters)
+{
+	// Retries and late chunks are logged, which is what this test is about
+	AddExpectedError(TEXT("asking for it again"), EAutomationExpectedErrorFlags::Contains, UReplicatedTextureComponent::maxChunkRetries);
+	AddExpectedError(TEXT("Too many damaged chunks"), EAutomationExpectedErrorFlags::Contains, 1);
+	AddExpectedError(TEXT("downloading it again"), EAutomationExpectedErrorFlags::Contains, 1);
+	AddExpectedError(TEXT("that wasn't asked for"), EAutomationExpectedErrorFlags::Contains, 3);
+	AddExpectedError(TEXT("size bigger than max"), EAutomationExpectedErrorFlags::Contains, 1);
+
+	// Storage is shared by every component, the test gets its own for a while
+	AReplicatedTexturesStorage* previousStorage = UReplicatedTextureComponent::textureStorage;
+
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& context = GEngine->CreateNewWorldContext(EWorldType::Game);
+	context.SetCurrentWorld(world);
+
+	UReplicatedTextureComponent::textureStorage = world->SpawnActor<AReplicatedTexturesStorage>();
+	APlayerController* player = world->SpawnActor<APlayerController>();
+	UReplicatedTextureComponent* component = NewObject<UReplicatedTextureComponent>(player);
+
+	const uint64 chunkSize = UReplicatedTextureComponent::maxChunkSize;
+	const FString name = TEXT("StaleChunks");
+
+	TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe> content = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>();
+	content->SetNumUninitialized(chunkSize * 3);
+	for (int64 i = 0; i < content->Num(); i++)
+	{
+		(*content)[i] = uint8(i * 31);
+	}
+	const FTextureBufferRef buffer = content;
+
+	FTextureTransferHeader header;
+	header.compressedSize = content->Num();
+	UReplicatedTextureComponent::textureStorage->textureHeaders.Add(name, header);
+
+	// All three chunks are asked for at once
+	component->enqueue(name);
+	component->startTransfer(name);
+	component->requestChunks();
+	TestEqual(TEXT("Every chunk is in flight"), component->activeTransfers.FindChecked(name).chunksInFlight.Num(), 3);
+
+	// First chunk keeps arriving damaged until the download starts over
+	for (int32 i = 0; i <= UReplicatedTextureComponent::maxChunkRetries; i++)
+	{
+		const FReplicatedTextureChunk damaged = makeChunk(buffer, 0, true);
+		TestTrue(TEXT("Damaged chunk passes validation"), component->replicateChunkServer_Validate(damaged, 0, name));
+		component->recieveChunk(damaged, 0, name);
+	}
+	TestFalse(TEXT("Download was started over"), component->activeTransfers.Contains(name));
+	TestTrue(TEXT("Download was queued again"), component->namedQueue.Contains(name));
+
+	component->startTransfer(name);
+
+	// Chunks asked for by the first attempt arrive after the retry
+	for (uint64 begin = chunkSize; begin < (uint64)content->Num(); begin += chunkSize)
+	{
+		const FReplicatedTextureChunk stale = makeChunk(buffer, begin, false);
+		TestTrue(TEXT("Stale chunk passes validation"), component->replicateChunkServer_Validate(stale, begin, name));
+		component->recieveChunk(stale, begin, name);
+	}
+
+	const FTextureTransfer& retried = component->activeTransfers.FindChecked(name);
+	TestEqual(TEXT("Stale chunks aren't written into the new download"), retried.receivedSize, (uint64)0);
+	TestTrue(TEXT("New download asks for its chunks itself"), retried.chunksInFlight.IsEmpty());
+
+	// And after the download was cancelled completely
+	component->dropTransfer(name);
+	const FReplicatedTextureChunk cancelled = makeChunk(buffer, 0, false);
+	TestTrue(TEXT("Chunk of a cancelled download passes validation"), component->replicateChunkServer_Validate(cancelled, 0, name));
+	component->recieveChunk(cancelled, 0, name);
+
+	// Only a chunk no client could have sent is rejected
+	TSharedRef<TArray64<uint8>, ESPMode::ThreadSafe> oversized = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>();
+	oversized->SetNumZeroed(chunkSize + 1);
+	FReplicatedTextureChunk tooBig = makeChunk(oversized, 0, false);
+	tooBig.size = oversized->Num();
+	TestFalse(TEXT("Chunk bigger than max fails validation"), component->replicateChunkServer_Validate(tooBig, 0, name));
+
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+	UReplicatedTextureComponent::textureStorage = previousStorage;
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintAsyncActionBase.h"
+#include "ReplicatedTextureComponent.h"
+#include "ReplicatedTextureAsyncAction.generated.h"
+
+// Latent node for ReplicateTexrureFromFileAsync, the file is read and decoded without stalling the game thread
+UCLASS()
+class TEXTUREREPLICATION_API UReplicateTexrureFromFileAction : public UBlueprintAsyncActionBase
+{
+	GENERATED_BODY()
+
+public:
+
+	// Texture is created and its replication started
+	UPROPERTY(BlueprintAssignable)
+	FOnTextureReady OnStarted;
+
+	// Texture is null
+	UPROPERTY(BlueprintAssignable)
+	FOnTextureReady OnFailed;
+
+	UFUNCTION(BlueprintCallable, Category = "Texture Replication", meta = (BlueprintInternalUseOnly = "true", DisplayName = "Replicate Texrure From File Async"))
+	static UReplicateTexrureFromFileAction* ReplicateTexrureFromFileAsync(UReplicatedTextureComponent* component, const FString& path
+		, const FString& name, ETextureCodec codec = ETextureCodec::Default, int32 priority = 0);
+
+	virtual void Activate() override;
+
+private:
+
+	UPROPERTY()
+	TObjectPtr<UReplicatedTextureComponent> component;
+
+	FString path;
+
+	FString name;
+
+	ETextureCodec codec = ETextureCodec::Default;
+
+	int32 priority = 0;
+};
@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicatedTextureAtlas.generated.h"
+
+struct FDecodedTexture;
+class UTexture2D;
+
+// Where a texture packed into an atlas is
+USTRUCT(BlueprintType)
+struct FReplicatedTextureAtlasSlot
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	TObjectPtr<UTexture2D> page = nullptr;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	FVector2D uvMin = FVector2D::ZeroVector;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	FVector2D uvMax = FVector2D::ZeroVector;
+};
+
+// Row of slots with the same height, filled from left to right
+struct FAtlasShelf
+{
+	int32 y = 0;
+	int32 height = 0;
+	int32 x = 0;
+};
+
+struct FAtlasPageLayout
+{
+	int32 size = 0;
+
+	bool bSRGB = true;
+
+	// Top of the next shelf
+	int32 top = 0;
+
+	int32 numSlots = 0;
+
+	TArray<FAtlasShelf> shelves;
+
+	// Slots of removed textures, reused before the shelves grow
+	TArray<FIntRect> freeRects;
+};
+
+// Packs small recieved BGRA8 textures into shared pages, so clients create fewer GPU resources
+// Used on game thread only
+USTRUCT()
+struct FTextureAtlas
+{
+	GENERATED_BODY()
+
+public:
+
+	// Empty pixels around each texture, so filtering doesn't pick up its neighbours
+	const static int32 padding = 1;
+
+	// Checks size, format and settings, can be called on any thread
+	// Such textures keep their pixels after decoding instead of building platform data
+	static bool CanAdd(const FDecodedTexture& decoded);
+
+	// Uploads the texture into a page with a free slot
+	// Returns the page, or null if the texture doesn't fit
+	UTexture2D* Add(const FString& name, const FDecodedTexture& decoded);
+
+	// Frees the slot of the texture, the page is dropped once it is empty
+	// Returns GPU memory released with the page
+	int64 Remove(const FString& name);
+
+	bool Contains(const FString& name) const { return slots.Contains(name); }
+
+	// Texture pixels within its page
+	bool FindRect(const FString& name, FIntRect& rect) const;
+
+	bool FindSlot(const FString& name, FReplicatedTextureAtlasSlot& slot) const;
+
+private:
+
+	// Slot rect includes padding
+	struct FAtlasSlot
+	{
+		int32 page = INDEX_NONE;
+		FIntRect rect;
+	};
+
+	// Empty entries are reused, so slots keep their page index
+	UPROPERTY()
+	TArray<TObjectPtr<UTexture2D>> pages;
+
+	TArray<FAtlasPageLayout> layouts;
+
+	TMap<FString, FAtlasSlot> slots;
+
+	bool allocate(FAtlasPageLayout& layout, int32 width, int32 height, FIntRect& rect) const;
+
+	// Returns index of the new page
+	int32 addPage(bool bSRGB);
+};
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+
+// Filled in when the run finishes or times out
+struct FReplicatedTextureBenchmarkResult
+{
+	bool bRunning = true;
+
+	bool bTimedOut = false;
+
+	int32 numTextures = 0;
+
+	// Time until all jobs were done
+	double seconds = 0;
+
+	// Chunks sent by components and pushed through the shared stream
+	int64 bytesSent = 0;
+
+	double bytesPerSecond = 0;
+
+	// Highest used physical memory above what was used when the run started
+	int64 peakMemory = 0;
+
+	// Game thread time of a frame during the run
+	double averageGameThreadMs = 0;
+	double maxGameThreadMs = 0;
+};
+
+// Replicates generated textures of growing sizes from a server to its clients and reports how it went
+// Used by ReplicatedTexture.Benchmark console command and by the automation test
+class TEXTUREREPLICATION_API FReplicatedTextureBenchmark
+{
+public:
+
+	// Args are the same as the console command takes
+	// Returns null if the world isn't a server with replicated texture components
+	static TSharedPtr<FReplicatedTextureBenchmarkResult> Start(UWorld* world, const FString& args);
+};
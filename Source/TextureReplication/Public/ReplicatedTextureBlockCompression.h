@@ -0,0 +1,31 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelFormat.h"
+
+struct FDecodedTexture;
+
+// Block compresses recieved BGRA8 pixels on CPU, so clients keep BC1 or BC3 textures in GPU memory
+// Encoder fits endpoints to the bounding box of each block, it is fast rather than precise
+class TEXTUREREPLICATION_API FTextureBlockCompression
+{
+public:
+
+	const static int32 blockSize = 4;
+
+	// Checks settings, format, size and whether this platform samples BC formats
+	// Can be called on any thread
+	static bool CanCompress(const FDecodedTexture& decoded);
+
+	// Replaces pixels with BC1 blocks, or BC3 if any pixel isn't opaque
+	static bool Compress(FDecodedTexture& decoded);
+
+	static bool IsBlockFormat(EPixelFormat format) { return format == PF_DXT1 || format == PF_DXT5; }
+
+	static int32 GetBlockBytes(EPixelFormat format) { return format == PF_DXT1 ? 8 : 16; }
+
+	// Width and height must be multiples of blockSize, pitch is in bytes
+	static void CompressPixels(const uint8* pixels, int32 width, int32 height, int64 pitch, EPixelFormat format, TArray64<uint8>& blocks);
+};
@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicatedTextureTypes.h"
+
+// Packs small textures into one transfer, so each of them doesn't pay for its own RPCs and chunks
+class TEXTUREREPLICATION_API FTextureBundles
+{
+public:
+
+	// Bigger textures gain little from bundling and are sent on their own
+	const static int64 maxTextureSize = 1024 * 64;
+
+	const static int64 maxBundleSize = 1024 * 1024;
+
+	// Keeps the announcing RPC small
+	const static int32 maxTextures = 64;
+
+	// Bundle names start with the separator, so they never clash with textures or patches
+	static FString GetBundleName(uint64 contentHash);
+
+	// Groups small compressed textures of the batch into bundles
+	// Textures which didn't fit into any bundle are sent on their own
+	static void Pack(FCompressedBatch& batch);
+
+	// Checks sizes and names without looking into the buffer
+	static bool Validate(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle);
+
+	// Splits the bundle into buffers of its textures
+	static bool Unpack(const FTextureBundle& bundle, TArrayView64<const uint8> buffer, TArray<FTextureBufferRef>& buffers);
+};
@@ -0,0 +1,101 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelFormat.h"
+#include "Engine/Texture.h"
+#include "ReplicatedTextureTypes.h"
+
+struct FImage;
+class UTexture2D;
+
+// Pixels ready to be uploaded into a texture
+struct FDecodedTexture
+{
+	int32 width = 0;
+	int32 height = 0;
+	EPixelFormat format = PF_Unknown;
+	bool bSRGB = true;
+	TArray64<uint8> pixels;
+
+	// Filled for BGRA8 textures, so they can be patched later
+	TArray<uint64> tileHashes;
+
+	// Built from pixels on worker thread, so game thread only creates the texture
+	TUniquePtr<FTexturePlatformData> platformData;
+};
+
+// Turns textures into transferable buffers and back
+// Encoding and decoding run on background threads
+class TEXTUREREPLICATION_API ITextureCodec
+{
+public:
+
+	virtual ~ITextureCodec() = default;
+
+	// Fills the header with everything needed to decode the buffer
+	virtual bool Encode(const FImage& image, FTextureTransferHeader& header, TArray64<uint8>& buffer) const = 0;
+
+	// By default compresses the source image of the texture
+	virtual bool EncodeTexture(UTexture2D* texture, FTextureTransferHeader& header, TArray64<uint8>& buffer) const;
+
+	virtual bool Decode(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedTexture& decoded) const = 0;
+
+	// Checks the buffer matches the header without decoding it
+	// Relay server relies on it, by default anything passes
+	virtual bool Validate(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer) const;
+};
+
+class TEXTUREREPLICATION_API FTextureCodecs
+{
+public:
+
+	const static int32 maxSegments = 8;
+
+	// Bigger textures are rejected before anything is allocated for them
+	const static int32 maxDimension = 16384;
+
+	// Returns null for unknown codecs and for ETextureCodec::Default
+	static const ITextureCodec* Find(ETextureCodec codec);
+
+	// Replaces the codec used for the id, call it on module startup
+	static void Register(ETextureCodec codec, TSharedRef<ITextureCodec> implementation);
+
+	// Source image in the editor, otherwise mip 0 of a BGRA8 texture whose platform data is in memory
+	// Packaged builds have no source, so runtime canvases are read this way
+	static bool GetSourceImage(UTexture2D* texture, FImage& image);
+
+	// Checks the signature only
+	static bool IsPng(TArrayView64<const uint8> buffer);
+
+	// Moves image pixels into decoded texture, converting them if they can't be uploaded as is
+	static void MoveImage(FImage& image, FDecodedTexture& decoded);
+
+	// Moves decoded pixels into platform data, can be called on any thread
+	static bool PreparePlatformData(FDecodedTexture& decoded);
+
+	// Takes prepared platform data, or builds it if it isn't prepared
+	// Must be called on game thread
+	static UTexture2D* CreateTexture(FDecodedTexture& decoded);
+
+	// Replaces texture content, so references to it stay valid
+	// Must be called on game thread
+	static bool UpdateTexture(UTexture2D* texture, FDecodedTexture& decoded);
+
+	// Encodes downscaled copies of the image followed by the image itself
+	static bool EncodeProgressive(const ITextureCodec& codec, const FImage& image, int32 minSize, FTextureTransferHeader& header, TArray64<uint8>& buffer);
+
+	// Validates every segment with its codec
+	static bool Validate(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer);
+
+	// Buffer which isn't progressive is a single segment
+	static int32 GetNumSegments(const FTextureTransferHeader& header);
+
+	// Returns header describing the segment alone and its place in the buffer
+	static FTextureTransferHeader GetSegment(const FTextureTransferHeader& header, int32 index, int64& offset, int64& size);
+
+private:
+
+	static TMap<ETextureCodec, TSharedRef<ITextureCodec>>& GetCodecs();
+};
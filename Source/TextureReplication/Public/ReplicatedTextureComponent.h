@@ -3,11 +3,18 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
 #include "Components/ActorComponent.h"
 #include "ReplicatedTexturesStorage.h"
+#include "ReplicatedTextureStats.h"
+#include "ReplicatedTextureTypes.h"
 #include "ReplicatedTextureComponent.generated.h"
 
+struct FDecodedPatch;
+struct FDecodedTexture;
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnTextureReady, const FString&, name, UTexture2D*, texture);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnTextureProgress, const FString&, name, UTexture2D*, texture, float, progress);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnQueueEmpty);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnAllJobsDone);
 
@@ -22,15 +29,42 @@ class UReplicatedTextureComponent : public UActorComponent
 public:
 
 	const static uint64 maxChunkSize = 1024 * 50; 
-	const static uint64 maxBufferSize = 1024 * 500; 
+
+	// Damaged chunks of one download asked for again before it is given up
+	const static int32 maxChunkRetries = 8;
+
+	// Whole downloads started again when their content hash doesn't match
+	const static int32 maxTransferRetries = 2;
+
+	// Seconds a served buffer stays pinned after the other side stopped asking for its chunks
+	static constexpr double servedTimeout = 30.0;
 
 	static AReplicatedTexturesStorage* textureStorage;
 
+	// Part of a chunk pushed through the shared stream, used if its texture is being downloaded
+	void RecieveStreamPart(const FString& name, uint64 begin, const FReplicatedTextureChunk& part);
+
 	UPROPERTY(EditDefaultsOnly)
 	bool bPauseReplication;
 
+	// How many chunks can be asked for before the first of them arrives
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = "1"))
+	int32 maxChunksInFlight;
+
+	// How many textures can be downloaded at the same time
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = "1"))
+	int32 maxConcurrentTransfers;
+
+	// Bytes which can be asked for at once, shared by all downloads
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = "1"))
+	int32 maxBytesInFlight;
+
 private:
 
+	// Drives a download by hand to check what happens to chunks which arrive late
+	friend class FReplicatedTextureStaleChunksTest;
+
+	// Highest priority first, equal priorities in arrival order
 	UPROPERTY(VisibleAnywhere)
 	TArray<FString> namedQueue;
 
@@ -41,9 +75,51 @@ private:
 	UPROPERTY(VisibleAnywhere)
 	bool bClientJobDone;
 
-	FString currentDownloadName;
-	bool isDownloading;
-	bool chunkReady;
+	TMap<FString, FTextureTransfer> activeTransfers;
+
+	// Downloads which are finished, but not decompressed yet
+	int32 pendingDecodes;
+
+	// Rotates which download asks first, so chunks are interleaved fairly
+	int32 scheduleOffset;
+
+	// FPlatformTime::Seconds of the last part of any texture from the shared stream
+	double lastStreamPartTime;
+
+	// Chunks asked for by the other side, highest priority first, then oldest
+	TArray<FChunkRequest> chunkRequests;
+
+	// Limits what is sent through this component's connection
+	FTokenBucket bandwidth;
+
+	// Buffers this component is sending and when their chunks were last asked for
+	// Pinned until the other side finishes, disconnects or stops asking
+	TMap<FString, double> servedTextures;
+
+	// Downloads started again after a failed hash check
+	TMap<FString, int32> transferRetries;
+
+	// When queued textures were added, moved into their transfer once it starts
+	TMap<FString, double> queuedTimes;
+
+	// Totals of this component for GetTransferStats
+	int64 bytesSent;
+	int64 bytesRecieved;
+	int32 numChunkRetries;
+	int32 numTransferRetries;
+
+	// Textures with a patch being compressed
+	TSet<FString> updatesInProgress;
+
+	// Latest texture passed to UpdateTexture while the previous patch was compressed
+	TMap<FString, TWeakObjectPtr<UTexture2D>> queuedUpdates;
+
+	// Textures and patches this client was told about
+	// Valid on the server only
+	TSet<FString> announcedTextures;
+
+	// When textures with relevancy are checked again
+	double nextRelevancyUpdate;
 
 
 public:
@@ -52,6 +128,16 @@ public:
 	UPROPERTY(BlueprintAssignable)
 	FOnTextureReady OnTextureReady;
 
+	// Triggered when a low resolution copy of progressive texture arrives
+	// Texture is updated in place, the same one is passed to OnTextureReady
+	UPROPERTY(BlueprintAssignable)
+	FOnTextureProgress OnTextureProgress;
+
+	// Triggered when a patch is applied to a loaded texture
+	// Texture is a new object only if the old one was shared with another name
+	UPROPERTY(BlueprintAssignable)
+	FOnTextureReady OnTextureUpdated;
+
 	// Triggered when local queue is emtpy
 	UPROPERTY(BlueprintAssignable)
 	FOnQueueEmpty OnQueueEmpty;
@@ -65,20 +151,52 @@ public:
 
 public:
 
+	// Textures with higher priority are downloaded first and pause downloads of lower ones
 	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
-	bool ReplicateTexrure(UTexture2D* texture, const FString& name);
+	bool ReplicateTexrure(UTexture2D* texture, const FString& name, ETextureCodec codec = ETextureCodec::Default, int32 priority = 0);
 
+	// Replicates many textures at once, they are compressed in parallel
+	// Small ones are packed into bundles, each of them is sent as one transfer
+	// OnTextureReady is still triggered for every texture
 	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
-	bool ReplicateTexrureFromFile(const FString& path, const FString& name);
+	bool ReplicateTextures(const TArray<UTexture2D*>& textures, const TArray<FString>& names, ETextureCodec codec = ETextureCodec::Default, int32 priority = 0);
+
+	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
+	bool ReplicateTexrureFromFile(const FString& path, const FString& name, ETextureCodec codec = ETextureCodec::Default, int32 priority = 0);
+
+	// Reads and decodes the file on a worker thread, PNG files are sent as they are if PNG is the codec
+	// Future is set on game thread with the created texture, or null if it failed
+	// Blueprints use "Replicate Texrure From File Async" node
+	TFuture<UTexture2D*> ReplicateTexrureFromFileAsync(const FString& path, const FString& name, ETextureCodec codec = ETextureCodec::Default, int32 priority = 0);
+
+	// Replicates only tiles which differ from the previous version of the texture
+	// Receivers patch their texture in place, works for BGRA8 textures only
+	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
+	bool UpdateTexture(UTexture2D* texture, const FString& name);
 
 	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
 	const TArray<FString>& GetLoadedTexturesNames() const;
 
 	// Returns texture by name if found and lodaed
 	// Otherwise returns null
+	// Texture packed into an atlas returns its page
 	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
 	const UTexture2D* FindTexture(const FString& name) const;
 
+	// Page and UV rect of a texture packed into an atlas
+	// Returns false if the texture isn't loaded or has its own texture
+	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
+	bool FindAtlasSlot(const FString& name, FReplicatedTextureAtlasSlot& slot) const;
+
+	// Limits which players get the texture, it can be set before the texture is replicated
+	// Call it only from server
+	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
+	void SetTextureRelevancy(const FString& name, const FTextureRelevancy& relevancy);
+
+	// Starts downloading a texture announced on demand, FindTexture does it too
+	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
+	void RequestTexture(const FString& name);
+
 	// Pauses replication only within this component
 	// Call it only from server
 	UFUNCTION(BlueprintCallable, NetMulticast, Reliable, Category = "Texture Replication")
@@ -90,30 +208,42 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
 	bool GetClientJobDone() const { return bClientJobDone; }
 
+	// Downloads in progress and totals of this component
+	UFUNCTION(BlueprintCallable, Category = "Texture Replication")
+	FReplicatedTextureStats GetTransferStats() const;
+
 public:	
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
 protected:
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	void GetLifetimeReplicatedProps(TArray< FLifetimeProperty >& OutLifetimeProps) const override;
 
 
 private:
 
 	UFUNCTION(Server, Reliable, WithValidation)
-	void replicateTextureServer(const FString& name);
+	void replicateTextureServer(const FString& name, const FTextureTransferHeader& header);
 
 	UFUNCTION(Client, Reliable)
-	void replicateTextureOwner(const FString& name);
+	void replicateTextureOwner(const FString& name, const FTextureTransferHeader& header);
+
+	UFUNCTION(Server, Reliable, WithValidation)
+	void replicateBundleServer(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle);
+
+	UFUNCTION(Client, Reliable)
+	void replicateBundleOwner(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle);
 
 	// Accept chunk from owner on server
 	UFUNCTION(Server, Reliable, WithValidation)
-	void replicateChunkServer(const TArray<uint8>& chunk, bool end, const FString& textureName);
+	void replicateChunkServer(const FReplicatedTextureChunk& chunk, uint64 begin, const FString& textureName);
 
 	// Accept chunk from server on owner
 	UFUNCTION(Client, Reliable)
-	void replicateChunkOwner(const TArray<uint8>& chunk, bool end, const FString& textureName);
+	void replicateChunkOwner(const FReplicatedTextureChunk& chunk, uint64 begin, const FString& textureName);
 
 	// Call from client to fetch textures with server
 	UFUNCTION(Server, Reliable)
@@ -129,31 +259,244 @@ private:
 	UFUNCTION(Server, Reliable)
 	void queueEmtpyServer();
 
+	// Ask server for a texture this client evicted
+	UFUNCTION(Server, Reliable)
+	void fetchTextureServer(const FString& name);
+
+	// Buffer asked for doesn't exist anymore
+	UFUNCTION(Client, Reliable)
+	void cancelTransferOwner(const FString& name);
+
+	UFUNCTION(Server, Reliable)
+	void cancelTransferServer(const FString& name);
+
 private:
 
 	UFUNCTION()
 	void RepNotifyAllJobDone();
 
-	uint64 getChunk(const FString& name, uint64 begin, TArray<uint8>& chunk) const;
+	// Returns false if there is no such buffer anymore
+	bool getChunk(const FString& name, uint64 begin, FReplicatedTextureChunk& chunk) const;
+
+	// Answer chunk requests as fast as the bandwidth budget allows
+	// Waits while gameplay traffic keeps the connection busy
+	void sendChunks();
+
+	// Unpin served buffers with no chunks waiting which weren't asked for in idleTime seconds
+	void releaseServedTextures(double idleTime);
+
+	static uint64 getContiguousSize(const FTextureTransfer& transfer);
+
+	// Continues from the start saved by an earlier session, if it's still on disk
+	// File is read on a worker, the download asks for no chunks until it's done
+	void resumeTransfer(FTextureTransfer& transfer);
+
+	// Saves what arrived of unfinished downloads into the disk cache
+	void savePartialTransfers();
+
+	// Feeds queue depths into stats and CSV profiler
+	void updateStats() const;
+
+	// Insert into the queue by priority of its header
+	void enqueue(const FString& name);
 
-	// Recieve and save chunk as needed
-	void recieveChunk(const TArray<uint8>& chunk, bool end, const FString& textureName);
+	// Priority from the header, 0 if it is unknown
+	int32 getPriority(const FString& name) const;
+
+	void addChunkRequest(const FString& name, uint64 begin);
+
+	// Share the in-flight budget between active downloads
+	void requestChunks();
+
+	// Ask for the next chunk of the download, if its window allows
+	bool requestNextChunk(FTextureTransfer& transfer);
+
+	// Recieve and save chunk at its offset
+	void recieveChunk(const FReplicatedTextureChunk& chunk, uint64 begin, const FString& textureName);
+
+	// Count a chunk already written into the buffer and finish the download with the last one
+	void acceptChunk(FTextureTransfer& transfer, uint64 begin, int32 size);
+
+	// Move a queued texture into active downloads
+	void startTransfer(const FString& name);
+
+	// Decode, relay or apply a complete buffer
+	// Content hash is checked only if the buffer isn't verified yet
+	void decodeTransfer(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer, bool bVerified = true);
+
+	void askChunk(const FString& name, uint64 begin);
+
+	// Checks the hash of a finished download on a worker thread before it is decoded
+	void verifyTransfer(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer);
+
+	// Downloads the texture again, or forgets it once it failed too many times
+	void retryTransfer(const FString& name);
+
+	// Limit from project settings
+	static int64 getMaxBufferSize();
+
+	// Header comes from another machine, check it before allocating anything
+	static bool isHeaderValid(const FTextureTransferHeader& header);
+
+	// Show the biggest progressive segment which arrived completely
+	void decodeProgress(FTextureTransfer& transfer);
+
+	static bool isHashValid(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer);
+
+	// Patch names are derived from the texture name and version, anything else is rejected
+	static bool isNameValid(const FString& name, const FTextureTransferHeader& header);
+
+	// Bundle and every texture in it
+	static bool isBundleValid(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle);
+
+	// Texture or patch is already here
+	bool isLoaded(const FString& name, const FTextureTransferHeader& header) const;
+
+	// Decompress, runs on worker thread
+	// Content hash must be checked before, if the buffer came from outside
+	static bool decodeBuffer(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedTexture& decoded);
+
+	// Small textures keep their pixels for the atlas, others get platform data, runs on worker thread
+	static bool prepareTexture(FDecodedTexture& decoded);
+
+	// Packs the texture into an atlas if it fits there, otherwise creates its own
+	UTexture2D* createTexture(const FString& name, FDecodedTexture& decoded);
+
+	// Create decoded texture and finish its replication
+	// Returns false and forgets the texture if it couldn't be created
+	bool finishDecode(const FString& name, FDecodedTexture& decoded, bool decodeSucceed);
+
+	// Dedicated server in relay mode doesn't decode anything
+	bool isRelay() const;
+
+	// Check recieved buffer without decoding it and forward it to everyone
+	void relayBuffer(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer, bool bVerified);
+
+	// Download bundle unless all its textures are already here
+	void addBundle(const FString& name, const FTextureTransferHeader& header, const FTextureBundle& bundle);
+
+	// Split verified bundle into textures on worker thread
+	void unpackBundle(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer);
+
+	// Looks bundle up on a worker thread and downloads it if it isn't cached
+	// Returns false if there is no disk cache to look in
+	bool loadBundleFromDiskCache(const FString& name, const FTextureTransferHeader& header);
+
+	// Forward the bundle and decode textures which aren't loaded yet
+	void finishBundle(const FString& name, const FTextureBundle& bundle, const TArray<FTextureBufferRef>& buffers, bool unpackSucceed);
+
+	// Decompress recieved patch and apply it once its base version is loaded
+	void decodePatch(const FString& name, const FTextureTransferHeader& header, const FTextureBufferRef& buffer, bool bVerified);
+
+	// Apply pending patches of the texture in version order
+	void applyPatches(const FString& name);
+
+	void applyPatch(const FString& name, const FDecodedPatch& patch);
+
+	// Diff the texture against its tiles on worker thread and announce the patch
+	void beginUpdateTexture(const FString& name, UTexture2D* texture);
+
+	// Queue on demand textures FindTexture was called for, with their patches
+	void downloadTextures();
+
+	// Park the texture until it is asked for, if it is announced on demand
+	bool deferDownload(const FString& name, const FTextureTransferHeader& header);
+
+	// Offer textures which became relevant to this client since it joined
+	void updateRelevancy();
+
+	// Whether this component's player should get the texture or patch
+	bool isRelevant(const FString& name) const;
+
+	bool isOnDemand(const FString& name) const;
+
+	// Stream actor, spawned on the server the first time it is needed
+	// Null if shared stream is disabled
+	AReplicatedTextureStream* getStream() const;
+
+	// Every player gets the texture or bundle right away, so it can be pushed to all of them at once
+	bool isStreamable(const FString& name) const;
+
+	// Announce texture to this component's client, if it is relevant for it
+	// Forced offer skips relevancy and isn't on demand
+	void offerTexture(const FString& name, bool bForce = false);
+
+	// Whole bundle if every texture in it is relevant and none is on demand, otherwise texture by texture
+	void offerBundle(const FString& name, bool bForce = false);
+
+	// Reload evicted textures FindTexture was called for
+	void reloadTextures();
+
+	// Decode evicted texture from its buffer and patches, or download it again if there is no buffer
+	void reloadTexture(const FString& name);
+
+	void cancelTransfer(const FString& name);
+
+	// Forgets the download and everything known about it
+	void dropTransfer(const FString& name);
+
+	// Load texture from disk cache on a worker thread, it is downloaded if it isn't cached
+	// Returns false if there is no disk cache to look in
+	bool loadFromDiskCache(const FString& name, const FTextureTransferHeader& header);
 
 	void replicateTextureToAll(const FString& name);
 
+	void replicateBundleToAll(const FString& name);
+
+	// Components of all player controllers
+	TArray<UReplicatedTextureComponent*> getPlayerComponents() const;
+
 	void preReplicateTexture(UTexture2D* texture, const FString& name);
 
-	void beginReplicateTexture(const FString& name);
+	void beginReplicateTexture(const FString& name, ETextureCodec codec, int32 priority);
+
+	// Source is moved into the worker task, its pixels are never copied
+	void beginReplicateSource(const FString& name, FImage&& source, ETextureCodec codec, int32 priority);
+
+	void beginReplicateBatch(const TArray<FString>& names, const TArray<UTexture2D*>& textures, ETextureCodec codec, int32 priority);
 
-	void beginReplicateSource(const FString& name, const FImage& source);
+	// Announce compressed texture to the server or to all clients
+	void announceTexture(const FString& name);
 
+	void announceBundle(const FString& name);
+
+	// Texture is null on relay server
 	void postReplicateTexture(UTexture2D* texture, const FString& name);
 
+	// Reuses loaded texture with the same content instead of downloading it
+	// Returns false if there is no such texture
+	bool aliasTexture(const FString& name, const FTextureTransferHeader& header);
+
 	bool shouldReplicateTexture(const FString& name);
 
-	bool compressImage(const FImage& image, const FString& name);
+	// Compression runs on worker thread and doesn't touch the storage
+	static bool compressImage(const FImage& image, const FString& name, ETextureCodec codec, FCompressedTexture& compressed);
+
+	static bool compressTexture(UTexture2D* texture, const FString& name, ETextureCodec codec, FCompressedTexture& compressed);
+
+	// Uses the file itself when it is already what the codec would produce
+	static bool compressFile(TArray64<uint8>&& file, const FImage& image, const FString& name, ETextureCodec codec, FCompressedTexture& compressed);
+
+	// What UpdateTexture diffs against
+	static void hashSourceTiles(const FImage& image, FCompressedTexture& compressed);
+
+	// Fill in the rest of the header, runs on worker thread
+	static bool sealCompressed(const FString& name, FTextureTransferHeader& header, const TArray64<uint8>& buffer);
+
+	// Store compressed texture and announce it, or forget it if compression failed
+	// Component is null if it was destroyed meanwhile
+	static void finishCompression(const FString& name, FCompressedTexture&& compressed, bool succeed, UReplicatedTextureComponent* component);
+
+	// Store bundles and textures of the batch, textures which are in no bundle are announced on their own
+	static void finishBatch(FCompressedBatch&& batch, UReplicatedTextureComponent* component);
+
+	// Keep the buffer in the storage
+	void storeCompressed(const FString& name, FCompressedTexture&& compressed);
+
+	void storeBundle(FCompressedBundle&& compressed);
 
-	bool compressTexture(const FString& name);
+	// Replaces ETextureCodec::Default with the one from project settings
+	ETextureCodec resolveCodec(ETextureCodec codec) const;
 
 	void notifyQueueEmtpy();
 };
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicatedTextureTypes.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+// Cached buffer mapped into memory, stays mapped while referenced
+struct FMappedTextureBuffer
+{
+	~FMappedTextureBuffer();
+
+	TArrayView64<const uint8> GetView() const;
+
+	IMappedFileHandle* handle = nullptr;
+	IMappedFileRegion* region = nullptr;
+};
+
+// Compressed buffers recieved by client, stored on disk by content hash
+// Least recently used files are deleted when the cache gets bigger than its limit
+class TEXTUREREPLICATION_API FReplicatedTextureDiskCache
+{
+public:
+
+	static FReplicatedTextureDiskCache& Get();
+
+	bool IsEnabled() const;
+
+	// Returns null if buffer isn't cached
+	// Opens and maps the file, so call it on a worker thread
+	// Content isn't verified here, compare its hash before using it
+	TSharedPtr<FMappedTextureBuffer, ESPMode::ThreadSafe> Load(uint64 hash) const;
+
+	// Writes buffer on a background thread
+	void Save(uint64 hash, const FTextureBufferRef& buffer);
+
+	void Remove(uint64 hash);
+
+	// Start of a buffer whose download was interrupted, written on a background thread
+	void SavePartial(uint64 hash, TArray64<uint8>&& prefix);
+
+	// Reads the saved start into the buffer and deletes the file, so it's used once
+	// Touches the disk, so it's called from a worker
+	// Returns its size, or 0 if there's none or it doesn't match the hash it was saved with
+	int64 LoadPartial(uint64 hash, TArrayView64<uint8> buffer);
+
+private:
+
+	FReplicatedTextureDiskCache();
+
+	FString getPath(uint64 hash) const;
+
+	FString getPartialPath(uint64 hash) const;
+
+	// Delete oldest files until the cache fits its limit
+	void trim();
+
+	FString directory;
+
+	FCriticalSection trimLock;
+};
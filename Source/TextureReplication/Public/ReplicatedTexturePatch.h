@@ -0,0 +1,67 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicatedTextureTypes.h"
+
+struct FImage;
+class UTexture2D;
+
+// Changed tiles of a texture, ready to be uploaded
+// Tiles are stacked into one column, each of them is tileSize rows high
+struct FDecodedPatch
+{
+	int32 version = 0;
+	int32 baseVersion = 0;
+	int32 width = 0;
+	int32 height = 0;
+	TArray<int32> tiles;
+	TArray64<uint8> pixels;
+};
+
+// Splits BGRA8 textures into tiles, so edits are replicated without the rest of the image
+class TEXTUREREPLICATION_API FTexturePatches
+{
+public:
+
+	const static int32 tileSize = 64;
+
+	// Character names of patch transfers are made with, not allowed in texture names
+	const static TCHAR separator = TEXT('#');
+
+	static FString GetPatchName(const FString& name, int32 version);
+
+	static void HashTiles(const uint8* pixels, int32 width, int32 height, TArray<uint64>& hashes);
+
+	// Packs tiles which differ from the old hashes
+	// Returns false if nothing changed or the image has another size
+	static bool Encode(const FImage& image, const TArray<uint64>& oldHashes, TArray<uint64>& newHashes, FTextureTransferHeader& header, TArray64<uint8>& buffer);
+
+	// Checks the header without decompressing the buffer
+	static bool Validate(const FTextureTransferHeader& header);
+
+	static bool Decode(const FTextureTransferHeader& header, TArrayView64<const uint8> buffer, FDecodedPatch& patch);
+
+	// Uploads the tiles into the texture in place
+	// Must be called on game thread
+	static bool Apply(UTexture2D* texture, const FDecodedPatch& patch);
+
+	// Target is where the patched texture is within the given one, like an atlas slot
+	static bool Apply(UTexture2D* texture, const FDecodedPatch& patch, const FIntRect& target);
+
+	// Writes the tiles into BGRA8 pixels of the whole texture
+	static bool ApplyToPixels(const FDecodedPatch& patch, TArray64<uint8>& pixels);
+
+	// Recomputes hashes of the tiles the patch changed
+	static void UpdateHashes(const FDecodedPatch& patch, TArray<uint64>& hashes);
+
+	// Makes a texture with the same content on GPU
+	// Must be called on game thread
+	static UTexture2D* CopyTexture(UTexture2D* texture);
+
+private:
+
+	// Tiles are block compressed into the format of the texture before they are uploaded
+	static bool applyBlocks(UTexture2D* texture, const FDecodedPatch& patch);
+};
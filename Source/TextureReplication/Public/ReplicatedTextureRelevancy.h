@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicatedTextureRelevancy.generated.h"
+
+class AActor;
+class APlayerController;
+
+// Which players a texture is sent to, everyone by default
+// Rules are combined, a player must pass all of them
+USTRUCT(BlueprintType)
+struct TEXTUREREPLICATION_API FTextureRelevancy
+{
+	GENERATED_BODY()
+
+	// Only these players get the texture, everyone if empty
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Texture Replication")
+	TArray<TObjectPtr<APlayerController>> recipients;
+
+	// Only players of this team get the texture, taken from IGenericTeamAgentInterface of the controller or its pawn
+	// 255 means any team
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Texture Replication")
+	uint8 team = 255;
+
+	// Only players closer than maxDistance to this actor get the texture
+	// Checked only while the actor exists
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Texture Replication")
+	TObjectPtr<AActor> owner = nullptr;
+
+	// 0 means any distance
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Texture Replication", meta = (ClampMin = "0", Units = "Centimeters"))
+	float maxDistance = 0;
+
+	// Clients are only told about the texture and download it once FindTexture asks for it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Texture Replication")
+	bool bOnDemand = false;
+
+public:
+
+	bool IsRelevant(const APlayerController* player) const;
+};
@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "ReplicatedTextureTypes.h"
+#include "ReplicatedTextureSettings.generated.h"
+
+UCLASS(config = Game, defaultconfig, meta = (DisplayName = "Texture Replication"))
+class TEXTUREREPLICATION_API UReplicatedTextureSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+
+	// Codec used when a texture is replicated with ETextureCodec::Default
+	UPROPERTY(config, EditAnywhere, Category = "Compression")
+	ETextureCodec defaultCodec = ETextureCodec::Png;
+
+	// Overrides default codec on dedicated server, where CPU is usually tighter than bandwidth
+	UPROPERTY(config, EditAnywhere, Category = "Compression")
+	ETextureCodec dedicatedServerCodec = ETextureCodec::Default;
+
+	// Dedicated server only checks recieved buffers and forwards them, it never decodes textures
+	// FindTexture returns null there
+	UPROPERTY(config, EditAnywhere, Category = "Transfer")
+	bool bRelayOnDedicatedServer = false;
+
+	// Bigger textures are rejected, both when sent and when recieved
+	UPROPERTY(config, EditAnywhere, Category = "Transfer", meta = (ClampMin = "1", ClampMax = "1024", Units = "Megabytes"))
+	int32 maxTextureSizeMB = 16;
+
+	// Clients download textures only once FindTexture asks for them
+	// Relevancy set for a texture overrides it
+	UPROPERTY(config, EditAnywhere, Category = "Transfer")
+	bool bPullOnDemand = false;
+
+	// Server pushes each chunk once through a replicated stream instead of answering every client
+	// Textures with relevancy or pulled on demand are still sent to each client on its own
+	UPROPERTY(config, EditAnywhere, Category = "Transfer")
+	bool bSharedStream = false;
+
+	// Chunk bytes pushed through the shared stream per second
+	// Stream pushes up to 50 KB per net update, so at 30 updates a second it never goes above about 1.5 MB
+	UPROPERTY(config, EditAnywhere, Category = "Transfer", meta = (ClampMin = "1", Units = "Kilobytes", EditCondition = "bSharedStream"))
+	int32 streamKBPerSecond = 128;
+
+	// Client asks for chunks itself once the stream was silent this long, e.g. when it joined late
+	UPROPERTY(config, EditAnywhere, Category = "Transfer", meta = (ClampMin = "0.1", Units = "Seconds", EditCondition = "bSharedStream"))
+	float streamFallbackDelay = 1.0f;
+
+	// How often textures with relevancy are checked again for players who didn't get them
+	UPROPERTY(config, EditAnywhere, Category = "Transfer", meta = (ClampMin = "0.1", Units = "Seconds"))
+	float relevancyUpdateInterval = 1.0f;
+
+	// Send downscaled copies first, so receivers can show something before the whole texture arrives
+	// Not used with platform codec
+	UPROPERTY(config, EditAnywhere, Category = "Transfer")
+	bool bProgressive = false;
+
+	// Smallest copy sent in progressive mode
+	UPROPERTY(config, EditAnywhere, Category = "Transfer", meta = (EditCondition = "bProgressive", ClampMin = "1"))
+	int32 progressiveMinSize = 64;
+
+	// Chunk bytes sent per second to one connection
+	UPROPERTY(config, EditAnywhere, Category = "Bandwidth", meta = (ClampMin = "1", Units = "Kilobytes"))
+	int32 connectionKBPerSecond = 256;
+
+	// Chunk bytes sent per second to all connections together
+	UPROPERTY(config, EditAnywhere, Category = "Bandwidth", meta = (ClampMin = "1", Units = "Kilobytes"))
+	int32 serverKBPerSecond = 4096;
+
+	// Part of the connection speed textures can use, the rest is left for gameplay
+	UPROPERTY(config, EditAnywhere, Category = "Bandwidth", meta = (ClampMin = "0.05", ClampMax = "1"))
+	float netSpeedShare = 0.5f;
+
+	// Decoded textures kept loaded, least recently used are evicted and decoded again when needed
+	// 0 means no limit
+	UPROPERTY(config, EditAnywhere, Category = "Memory", meta = (ClampMin = "0", Units = "Megabytes"))
+	int32 maxTexturesMB = 0;
+
+	// Compressed buffers kept in memory, 0 means no limit
+	// Server forgets textures whose buffers are evicted, so players joining later won't get them
+	UPROPERTY(config, EditAnywhere, Category = "Memory", meta = (ClampMin = "0", Units = "Megabytes"))
+	int32 maxBuffersMB = 0;
+
+	// Dedicated server drops textures as soon as they are decoded and keeps only compressed bytes
+	UPROPERTY(config, EditAnywhere, Category = "Memory")
+	bool bDedicatedServerKeepsOnlyCompressed = false;
+
+	// Recieved BGRA8 textures are block compressed on worker threads into BC1, or BC3 if they have alpha
+	// Takes 4 to 8 times less GPU memory at some quality cost, skipped where BC formats aren't supported
+	UPROPERTY(config, EditAnywhere, Category = "Memory")
+	bool bBlockCompressRecievedTextures = false;
+
+	// Pack small recieved BGRA8 textures into shared pages, so clients create fewer GPU resources
+	// FindTexture and OnTextureReady give the page, FindAtlasSlot gives its UV rect
+	UPROPERTY(config, EditAnywhere, Category = "Atlas")
+	bool bUseAtlas = false;
+
+	UPROPERTY(config, EditAnywhere, Category = "Atlas", meta = (EditCondition = "bUseAtlas", ClampMin = "256", ClampMax = "8192"))
+	int32 atlasPageSize = 2048;
+
+	// Bigger textures get their own texture
+	UPROPERTY(config, EditAnywhere, Category = "Atlas", meta = (EditCondition = "bUseAtlas", ClampMin = "1", ClampMax = "1024"))
+	int32 atlasMaxTextureSize = 256;
+
+	// Keep recieved textures on disk, so reconnecting clients don't download them again
+	// Downloads cut by a disconnect are resumed only with it, what arrived of them is kept here too
+	UPROPERTY(config, EditAnywhere, Category = "Disk Cache")
+	bool bUseDiskCache = false;
+
+	UPROPERTY(config, EditAnywhere, Category = "Disk Cache", meta = (EditCondition = "bUseDiskCache", ClampMin = "1", Units = "Megabytes"))
+	int32 diskCacheSizeMB = 512;
+};
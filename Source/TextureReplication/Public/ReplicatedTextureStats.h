@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Stats/Stats.h"
+#include "ReplicatedTextureStats.generated.h"
+
+// "stat TextureReplication" in the console, counters are summed over all components each frame
+DECLARE_STATS_GROUP(TEXT("TextureReplication"), STATGROUP_TextureReplication, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Compress"), STAT_TextureReplication_Compress, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decode"), STAT_TextureReplication_Decode, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Block compress"), STAT_TextureReplication_BlockCompress, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Queued textures"), STAT_TextureReplication_Queued, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active transfers"), STAT_TextureReplication_ActiveTransfers, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pending decodes"), STAT_TextureReplication_PendingDecodes, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes sent"), STAT_TextureReplication_BytesSent, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Bytes recieved"), STAT_TextureReplication_BytesRecieved, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Chunk retries"), STAT_TextureReplication_ChunkRetries, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Transfer retries"), STAT_TextureReplication_TransferRetries, STATGROUP_TextureReplication, TEXTUREREPLICATION_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(TEXTUREREPLICATION_API, TextureReplication);
+
+// Download in progress, times are in seconds
+USTRUCT(BlueprintType)
+struct FReplicatedTextureTransferStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	FString name;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 priority = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int64 totalSize = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int64 receivedSize = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 chunksInFlight = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 chunkRetries = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	bool bPaused = false;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	float timeInQueue = 0.f;
+
+	// Negative until the first chunk arrives
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	float timeToFirstChunk = -1.f;
+
+	// Since the download started
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	float elapsed = 0.f;
+};
+
+// Snapshot of one component, which is one connection
+USTRUCT(BlueprintType)
+struct FReplicatedTextureStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	TArray<FReplicatedTextureTransferStats> transfers;
+
+	// Waiting for a free slot, paused ones included
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 queuedTextures = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 pendingDecodes = 0;
+
+	// Chunks the other side asked for, which aren't sent yet
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 pendingChunkRequests = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int64 bytesSent = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int64 bytesRecieved = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 chunkRetries = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Texture Replication")
+	int32 transferRetries = 0;
+};
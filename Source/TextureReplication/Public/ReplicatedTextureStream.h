@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "ReplicatedTextureComponent.h"
+#include "ReplicatedTextureTypes.h"
+#include "ReplicatedTextureStream.generated.h"
+
+class AReplicatedTextureStream;
+
+USTRUCT()
+struct FReplicatedTextureStreamItem : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString name;
+
+	UPROPERTY()
+	uint64 begin = 0;
+
+	UPROPERTY()
+	FReplicatedTextureChunk part;
+
+	void PostReplicatedAdd(const struct FReplicatedTextureStreamItems& items);
+};
+
+USTRUCT()
+struct FReplicatedTextureStreamItems : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FReplicatedTextureStreamItem> items;
+
+	AReplicatedTextureStream* owner = nullptr;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FReplicatedTextureStreamItem, FReplicatedTextureStreamItems>(items, DeltaParms, *this);
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FReplicatedTextureStreamItems> : public TStructOpsTypeTraitsBase2<FReplicatedTextureStreamItems>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true,
+	};
+};
+
+// Server pushes chunks of a texture once and replication fans them out to every client
+// Only the latest parts are kept, clients pull chunks they missed from their component
+UCLASS(NotPlaceable, Transient)
+class AReplicatedTextureStream : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	// Bunches bigger than net.MaxConstructedPartialBunchSizeBytes, 64 KB by default, are rejected
+	// Chunks are pushed in parts and the stream keeps one chunk worth of them,
+	// so a player joining late gets the whole stream in one bunch
+	// No more parts than that are pushed per net update, so no other update is bigger either
+	const static int32 partsPerChunk = 8;
+
+	const static uint64 partSize = UReplicatedTextureComponent::maxChunkSize / partsPerChunk;
+
+	// Older parts are dropped
+	const static int32 maxItems = partsPerChunk;
+
+	AReplicatedTextureStream();
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	// Starts pushing the stored buffer, it is pinned until its last chunk is pushed
+	// Server only
+	void Push(const FString& name);
+
+	bool IsStreaming(const FString& name) const;
+
+	// Bytes pushed, counted once for every client connected when they were pushed
+	int64 GetBytesSent() const { return bytesSent; }
+
+	// Hands the chunk to the local player's component
+	void RecieveItem(const FReplicatedTextureStreamItem& item);
+
+private:
+
+	struct FStreamedTexture
+	{
+		FString name;
+		uint64 nextOffset = 0;
+		int32 priority = 0;
+	};
+
+	UPROPERTY(Replicated)
+	FReplicatedTextureStreamItems stream;
+
+	// Highest priority first, pushed in this order
+	TArray<FStreamedTexture> pending;
+
+	FTokenBucket bandwidth;
+
+	// FPlatformTime::Seconds when the next part can be pushed
+	double nextPushTime = 0;
+
+	int64 bytesSent = 0;
+};
@@ -0,0 +1,293 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicatedTextureTypes.generated.h"
+
+// Compressed texture, shared between the storage and every chunk sent from it
+typedef TSharedRef<const TArray64<uint8>, ESPMode::ThreadSafe> FTextureBufferRef;
+
+UENUM(BlueprintType)
+enum class ETextureCodec : uint8
+{
+	// Codec from project settings
+	Default,
+
+	Png,
+
+	// Raw pixels compressed with LZ4, fastest to encode and decode
+	LZ4,
+
+	// Raw pixels compressed with Oodle, smaller than LZ4 and still much faster than PNG
+	Oodle,
+
+	// Already compressed platform mip data, sent as is
+	Platform,
+};
+
+// Part of a progressive buffer, decodable on its own
+USTRUCT()
+struct FTextureSegment
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int64 size = 0;
+
+	UPROPERTY()
+	int32 width = 0;
+
+	UPROPERTY()
+	int32 height = 0;
+
+	UPROPERTY()
+	int64 rawSize = 0;
+};
+
+// Describes a compressed buffer, sent before any of its chunks
+USTRUCT()
+struct FTextureTransferHeader
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	ETextureCodec codec = ETextureCodec::Png;
+
+	UPROPERTY()
+	int32 width = 0;
+
+	UPROPERTY()
+	int32 height = 0;
+
+	// ERawImageFormat for raw codecs, EPixelFormat for platform data
+	UPROPERTY()
+	uint8 format = 0;
+
+	UPROPERTY()
+	bool bSRGB = true;
+
+	// Size of the pixels before compression
+	UPROPERTY()
+	int64 rawSize = 0;
+
+	// XXH64 of the compressed buffer, same content means same hash
+	UPROPERTY()
+	uint64 contentHash = 0;
+
+	// Lets the receiver allocate the whole buffer before the first chunk
+	UPROPERTY()
+	int64 compressedSize = 0;
+
+	UPROPERTY()
+	int32 numChunks = 0;
+
+	// Progressive buffer is split into images, smallest first, the last one is full size
+	// Empty if buffer isn't progressive
+	UPROPERTY()
+	TArray<FTextureSegment> segments;
+
+	// Texture changed tiles belong to, empty if buffer is a whole texture
+	UPROPERTY()
+	FString patchTarget;
+
+	// Patch can be applied only to the texture of base version
+	UPROPERTY()
+	int32 version = 0;
+
+	UPROPERTY()
+	int32 baseVersion = 0;
+
+	// Chunks come through the shared stream, client asks for them only if it falls behind
+	UPROPERTY()
+	bool bStreamed = false;
+
+	// Receiver downloads it only once FindTexture asks for it
+	UPROPERTY()
+	bool bOnDemand = false;
+
+	// Higher is downloaded first, patches get the priority of their texture
+	UPROPERTY()
+	int32 priority = 0;
+};
+
+// Textures packed into one buffer one after another, sent with the header of the bundle
+USTRUCT()
+struct FTextureBundle
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FString> names;
+
+	UPROPERTY()
+	TArray<FTextureTransferHeader> headers;
+};
+
+// Tile hashes of BGRA8 texture, compared against to find what was edited
+struct FTextureTiles
+{
+	int32 width = 0;
+	int32 height = 0;
+	TArray<uint64> hashes;
+};
+
+// Output of compression on worker thread, stored by game thread
+struct FCompressedTexture
+{
+	FTextureTransferHeader header;
+
+	TArray64<uint8> buffer;
+
+	// Empty if the texture can't be patched
+	FTextureTiles tiles;
+};
+
+// Bundle made on worker thread, stored by game thread
+struct FCompressedBundle
+{
+	FString name;
+
+	FTextureTransferHeader header;
+
+	FTextureBundle bundle;
+
+	TArray64<uint8> buffer;
+};
+
+// Output of batch compression, bundles reference textures by name
+struct FCompressedBatch
+{
+	TArray<FString> names;
+
+	TArray<FCompressedTexture> textures;
+
+	TArray<bool> succeeded;
+
+	TArray<FCompressedBundle> bundles;
+};
+
+// State of a texture being downloaded chunk by chunk
+struct FTextureTransfer
+{
+	FString name;
+
+	FTextureTransferHeader header;
+
+	// Size of the whole buffer, taken from the header
+	uint64 totalSize = 0;
+
+	// Offset of the next chunk to ask for
+	uint64 nextOffset = 0;
+
+	uint64 receivedSize = 0;
+
+	// Offsets of chunks which were asked, but didn't arrive yet
+	TSet<uint64> chunksInFlight;
+
+	// Chunks are written here at their offsets
+	TArray64<uint8> buffer;
+
+	// Progressive segments already shown
+	int32 segmentsDecoded = 0;
+
+	// Pushed out by higher priority transfers, asks for no chunks until it is resumed
+	bool bPaused = false;
+
+	// Start saved by an earlier session is being read into the buffer
+	bool bResuming = false;
+
+	// Damaged chunks asked for again
+	int32 chunkRetries = 0;
+
+	// Offsets of chunks recieved from the shared stream
+	TSet<uint64> streamedChunks;
+
+	// Parts of chunks which are still coming from the shared stream, one bit per part
+	TMap<uint64, uint8> streamedParts;
+
+	// FPlatformTime::Seconds of the last part from the shared stream, 0 until the first one arrives
+	double lastStreamTime = 0;
+
+	// FPlatformTime::Seconds of when it was queued, started and got its first chunk
+	double queuedTime = 0;
+	double startTime = 0;
+	double firstChunkTime = 0;
+
+	bool bDecodingSegment = false;
+};
+
+// Chunk asked for by the other side, sent once bandwidth allows
+struct FChunkRequest
+{
+	FString name;
+
+	uint64 begin = 0;
+
+	int32 priority = 0;
+};
+
+// CRC32 of each chunk of one stored buffer
+struct FChunkChecksums
+{
+	// Name can get another buffer, e.g. when it is downloaded again
+	TWeakPtr<const TArray64<uint8>, ESPMode::ThreadSafe> buffer;
+
+	TArray<TOptional<uint32>> values;
+};
+
+// Bytes which can be sent now, refilled with time
+// Goes below zero after a big send, which keeps the average rate right
+struct FTokenBucket
+{
+	// Bucket never holds more than this many seconds worth of bytes
+	static constexpr double maxBurst = 0.25;
+
+	double tokens = 0;
+
+	double lastRefillTime = 0;
+
+	void Refill(double bytesPerSecond, double now)
+	{
+		tokens = lastRefillTime > 0
+			? FMath::Min(tokens + (now - lastRefillTime) * bytesPerSecond, bytesPerSecond * maxBurst)
+			: bytesPerSecond * maxBurst;
+		lastRefillTime = now;
+	}
+
+	bool CanSend() const { return tokens > 0; }
+
+	void Consume(int64 bytes) { tokens -= bytes; }
+};
+
+// View into a stored buffer, serialized straight into the RPC
+// Sending doesn't copy the buffer, only recieving allocates one
+USTRUCT()
+struct FReplicatedTextureChunk
+{
+	GENERATED_BODY()
+
+	TSharedPtr<const TArray64<uint8>, ESPMode::ThreadSafe> buffer;
+
+	int64 offset = 0;
+
+	int32 size = 0;
+
+	// CRC32 of the data, filled in by the sender and checked by the reciever
+	uint32 checksum = 0;
+
+	bool IsValid() const;
+
+	const uint8* GetData() const { return buffer.IsValid() ? buffer->GetData() + offset : nullptr; }
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FReplicatedTextureChunk> : public TStructOpsTypeTraitsBase2<FReplicatedTextureChunk>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
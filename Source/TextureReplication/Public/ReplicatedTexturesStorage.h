@@ -4,8 +4,16 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "ReplicatedTextureAtlas.h"
+#include "ReplicatedTexturePatch.h"
+#include "ReplicatedTextureRelevancy.h"
+#include "ReplicatedTextureTypes.h"
 #include "ReplicatedTexturesStorage.generated.h"
 
+class AReplicatedTextureStream;
+
+// Used on game thread only
+// Worker threads get immutable shared buffers and pass their results back to game thread
 UCLASS()
 class AReplicatedTexturesStorage : public AActor
 {
@@ -16,13 +24,118 @@ public:
 	UPROPERTY(VisibleAnywhere, Category = "Texture Replication")
 	TMap<FString, TObjectPtr<UTexture2D>> replicatedTextures;
 
-	TMap<FString, TArray<uint8>> textureBuffers;
+	// Low resolution textures of progressive downloads
+	// Updated in place and moved to replicatedTextures once full size arrives
+	UPROPERTY(VisibleAnywhere, Category = "Texture Replication")
+	TMap<FString, TObjectPtr<UTexture2D>> progressTextures;
+
+	// Pages of textures packed together, replicatedTextures holds the page for each of them
+	UPROPERTY()
+	FTextureAtlas atlas;
+
+	// Compressed textures, immutable once added
+	// Chunks are sent as views into them
+	TMap<FString, FTextureBufferRef> textureBuffers;
+
+	// Checksums of chunks already sent, by buffer name
+	TMap<FString, FChunkChecksums> chunkChecksums;
+
+	// How to decode each buffer, known as soon as texture is announced
+	TMap<FString, FTextureTransferHeader> textureHeaders;
+
+	// First loaded texture for each content hash, used to skip downloading duplicates
+	TMap<uint64, FString> namesByHash;
+
+	// Version of each texture, increased by every patch applied to it
+	TMap<FString, int32> textureVersions;
+
+	// Only BGRA8 textures can be patched, others have no tiles
+	TMap<FString, FTextureTiles> textureTiles;
+
+	// Names of patch transfers already recieved or sent, their buffers are kept for late joiners
+	TSet<FString> patches;
+
+	// Patches which arrived before their base version, by texture name
+	TMap<FString, TArray<TSharedRef<FDecodedPatch, ESPMode::ThreadSafe>>> pendingPatches;
+
+	// Bundles by name, kept on the server for players joining later
+	TMap<FString, FTextureBundle> bundles;
+
+	// Bundle each texture was sent in
+	TMap<FString, FString> bundledTextures;
+
+	// Who gets each texture, set on the server by name
+	// Patches go to the same players as their texture
+	UPROPERTY()
+	TMap<FString, FTextureRelevancy> relevancy;
+
+	// Textures announced on demand which the client didn't download yet
+	TSet<FString> onDemand;
+
+	// On demand textures FindTexture was called for, waiting to be queued by a component
+	TSet<FString> downloadRequests;
+
+	// Loaded textures dropped to fit the memory budget, decoded again when asked for
+	// Relay server keeps all its textures here, they are never decoded
+	TSet<FString> evictedTextures;
+
+	// Evicted textures FindTexture was called for, waiting to be reloaded by a component
+	TSet<FString> reloadRequests;
+
+	TSet<FString> reloading;
+
+	// Last time each loaded texture was used, oldest are evicted first
+	TMap<FString, double> lastUsed;
+
+	// Loaded textures sorted by lastUsed, sorted again only after it changed
+	TArray<FString> evictionOrder;
+
+	bool bEvictionOrderDirty = false;
+
+	// Buffers still being sent, they are never evicted
+	TMap<FString, int32> pins;
+
+	// Shared by every component, limits what all connections get together
+	FTokenBucket bandwidth;
+
+	// Pushes chunks to every client at once, spawned on the server
+	UPROPERTY()
+	TObjectPtr<AReplicatedTextureStream> stream;
 
 	// Do not use for look ups
 	// Instead use TMap::Contains for better performance
 	// Use only  loadedTexturesNames to iterate existing TMap
 	TArray<FString> loadedTexturesNames;
-	
+
+public:
+
+	// Loaded, even if its texture is evicted
+	bool IsLoaded(const FString& name) const;
+
+	void Touch(const FString& name);
+
+	void Pin(const FString& name);
+
+	void Unpin(const FString& name);
+
+	void RequestReload(const FString& name);
+
+	void RequestDownload(const FString& name);
+
+	// Computed the first time the chunk is sent, every connection it goes to gets the same value
+	uint32 GetChunkChecksum(const FString& name, const FTextureBufferRef& buffer, uint64 begin, int32 size);
+
+	// Evict least recently used textures and buffers until storage fits memory budget from settings
+	void Trim();
+
+	// Remove texture and its patches completely
+	void Forget(const FString& name);
+
+	void AddBundle(const FString& name, const FTextureBundle& bundle);
+
+	// Remove the bundle and its buffer, its textures stay
+	void ForgetBundle(const FString& name);
+
 private:
 
 	AReplicatedTexturesStorage();
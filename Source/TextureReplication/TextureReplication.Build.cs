@@ -26,6 +26,8 @@ public class TextureReplication : ModuleRules
 			new string[]
 			{
 				"Core",
+				"DeveloperSettings",
+				"NetCore",
 				// ... add other public dependencies that you statically link with here ...
 			}
 			);
@@ -34,8 +36,12 @@ public class TextureReplication : ModuleRules
 		PrivateDependencyModuleNames.AddRange(
 			new string[]
 			{
+				"AIModule",
 				"CoreUObject",
 				"Engine",
+				"ImageCore",
+				"RenderCore",
+				"RHI",
 				"Slate",
 				"SlateCore",
 				// ... add private dependencies that you statically link with here ...	
@@ -43,6 +49,12 @@ public class TextureReplication : ModuleRules
 			);
 		
 		
+		// Benchmark automation test plays in editor
+		if (Target.bBuildEditor)
+		{
+			PrivateDependencyModuleNames.Add("UnrealEd");
+		}
+
 		DynamicallyLoadedModuleNames.AddRange(
 			new string[]
 			{